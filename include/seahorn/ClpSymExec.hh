@@ -34,7 +34,8 @@ namespace seahorn
     }
 
     ClpSmallSymExec (const ClpSmallSymExec& o) : 
-      SmallStepSymExec (o), m_pass (o.m_pass), m_trackLvl (o.m_trackLvl) {}
+      SmallStepSymExec (o), m_pass (o.m_pass), m_trackLvl (o.m_trackLvl),
+      m_td (o.m_td), m_canFail (o.m_canFail), zero (o.zero), one (o.one) {}
     
     Expr errorFlag (const BasicBlock &BB) override;
     
@@ -0,0 +1,42 @@
+#ifndef __EXPR_ORDER__HH_
+#define __EXPR_ORDER__HH_
+
+/**
+ * A total order on expressions that depends on their structure.
+
+ * The order on Expr compares node ids, that is, the order in which
+ * the nodes were created. When functions are encoded by several
+ * threads, that order depends on the interleaving of the threads.
+ * This order compares a digest of the structure of the nodes first,
+ * then their structure. Terminals are compared by their printed name,
+ * and only distinct terminals that print the same are ordered by id.
+ */
+
+#include "ufo/Expr.hpp"
+
+#include <boost/unordered_map.hpp>
+
+namespace seahorn
+{
+  using namespace expr;
+
+  class ExprOrder
+  {
+    /// digests of the nodes seen so far
+    boost::unordered_map<const ENode*, size_t> m_digests;
+    /// keeps the nodes of m_digests alive
+    ExprVector m_nodes;
+
+    size_t digest (Expr e);
+    /// compares distinct nodes with the same digest
+    bool structLess (Expr a, Expr b);
+
+  public:
+    bool less (Expr a, Expr b);
+
+    /// sorts v by the order
+    void sort (ExprVector &v);
+  };
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef __EXPR_SERIALIZE__HH_
+#define __EXPR_SERIALIZE__HH_
+
+/**
+ * Binary format for Expr DAGs.
+
+ * A section of 32-bit words holding a string table, a table of the
+ * names of the operators that are used, and the nodes of the DAG in
+ * post-order. A node refers to its children by their index, so shared
+ * sub-expressions are stored once. Terminals refer to the string
+ * table. LLVM values are stored by name, and are mapped back to
+ * values by an ExprValueResolver when one is given. Unnamed arguments
+ * and instructions are stored by their slot, their position in the
+ * function that contains them. Values that are not resolved become
+ * STRING terminals with the same printed name.
+
+ * The reader works directly on the words of the section, which is
+ * usually a file mapped in memory.
+ */
+
+#include "ufo/Expr.hpp"
+#include "ufo/ExprLlvm.hpp"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
+#include <stdint.h>
+
+namespace seahorn
+{
+  using namespace expr;
+
+  /// Maps names of LLVM values back to the values of a module
+  class ExprValueResolver
+  {
+    const llvm::Module &m_module;
+  public:
+    explicit ExprValueResolver (const llvm::Module &m) : m_module (m) {}
+
+    const llvm::Function *function (llvm::StringRef name) const;
+    /// a value local to function fn, or a global value if fn is empty
+    const llvm::Value *value (llvm::StringRef fn, llvm::StringRef name) const;
+    /// the argument or instruction of fn in the given slot
+    const llvm::Value *slot (llvm::StringRef fn, uint32_t n) const;
+  };
+
+  class ExprWriter
+  {
+    /// node records
+    std::vector<uint32_t> m_nodes;
+    uint32_t m_numNodes;
+    boost::unordered_map<const ENode*, uint32_t> m_ids;
+
+    std::vector<std::string> m_strings;
+    boost::unordered_map<std::string, uint32_t> m_stringIds;
+
+    /// operators used, as indices into the string table
+    std::vector<uint32_t> m_ops;
+    boost::unordered_map<std::string, uint32_t> m_opIds;
+
+    /// slots of the arguments and instructions of m_numbered
+    boost::unordered_map<const llvm::Value*, uint32_t> m_slots;
+    boost::unordered_set<const llvm::Function*> m_numbered;
+
+    bool m_ok;
+
+    uint32_t string (const std::string &s);
+    uint32_t opCode (const std::string &name);
+    uint32_t slot (const llvm::Function &fn, const llvm::Value *v);
+    void node (Expr e);
+
+  public:
+    ExprWriter () : m_numNodes (0), m_ok (true) {}
+
+    /// Adds e and all its sub-expressions. Returns the index of e
+    uint32_t add (Expr e);
+
+    /// false if some expression could not be represented
+    bool ok () const { return m_ok; }
+
+    /// Writes the section
+    void write (llvm::raw_ostream &out) const;
+  };
+
+  class ExprReader
+  {
+    ExprFactory &m_efac;
+    const ExprValueResolver *m_resolver;
+    ExprVector m_nodes;
+    /// number of functions, blocks and values that did not resolve
+    unsigned m_unresolved;
+
+  public:
+    ExprReader (ExprFactory &efac, const ExprValueResolver *resolver = nullptr) :
+      m_efac (efac), m_resolver (resolver), m_unresolved (0) {}
+
+    /// Reads the section starting at p. Returns the first word after
+    /// the section, or NULL if the section is malformed
+    const uint32_t *read (const uint32_t *p, const uint32_t *end);
+
+    /// the expression with the given index, or NULL
+    Expr get (uint32_t idx) const
+    { return idx < m_nodes.size () ? m_nodes [idx] : Expr (); }
+    size_t size () const { return m_nodes.size (); }
+
+    /// true if the resolver mapped back every function, block and
+    /// value of the last section read
+    bool resolved () const { return m_unresolved == 0; }
+  };
+}
+
+#endif
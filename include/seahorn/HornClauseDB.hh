@@ -6,6 +6,9 @@
 
 #include <boost/range.hpp>
 #include <boost/range/algorithm/copy.hpp>
+#include <boost/range/adaptor/filtered.hpp>
+#include <boost/unordered_set.hpp>
+#include <boost/unordered_map.hpp>
 #include <boost/lexical_cast.hpp>
 
 #include "ufo/Expr.hpp"
@@ -15,8 +18,14 @@ namespace seahorn
   using namespace llvm;
   using namespace expr;
 
+  class ExprValueResolver;
+  class ExprWriter;
+  class ExprReader;
+
   class HornRule
   { 
+    friend class HornClauseDB;
+    
     ExprVector m_vars;
     Expr m_head;
     Expr m_body; 
@@ -57,7 +66,10 @@ namespace seahorn
     }
 
     bool operator==(const HornRule & other) const
-    { return hash() == other.hash ();}
+    { 
+      return m_head == other.m_head && m_body == other.m_body && 
+        m_vars == other.m_vars;
+    }
 
     // return only the body of the horn clause
     Expr body () const {return m_body;}
@@ -75,7 +87,15 @@ namespace seahorn
     }
 
     const ExprVector &vars () const {return m_vars;} 
-        
+    
+  private:
+    /// turns the rule into the tombstone of a removed rule
+    void clear () 
+    {
+      m_vars.clear ();
+      m_head.reset ();
+      m_body.reset ();
+    }
   };
 
 
@@ -85,49 +105,96 @@ namespace seahorn
    public:
 
     typedef std::vector<HornRule> RuleVector;
+    /// position of a rule in the database. Ids are stable: removed
+    /// rules leave a tombstone behind
+    typedef unsigned RuleId;
+    typedef std::vector<RuleId> RuleIdVector;
+    
+   private:
+    struct IsLive 
+    {
+      bool operator() (const HornRule &r) const 
+      {return r.head ().get () != nullptr;}
+    };
+    
+   public:
+    typedef boost::filtered_range<IsLive, const RuleVector> RuleRange;
 
    private:
     
+    typedef boost::unordered_map<Expr, RuleIdVector> RuleIndex;
+    
     ExprFactory &m_efac;
     ExprVector m_rels;
-    mutable ExprVector m_vars;
+    boost::unordered_set<Expr> m_relSet;
+    /// variables of the live rules
+    ExprSet m_vars;
+    /// number of live rules that quantify each variable of m_vars
+    boost::unordered_map<Expr, unsigned> m_varRules;
     RuleVector m_rules;
+    /// relation -> rules with the relation in the head
+    RuleIndex m_heads;
+    /// predicate -> rules with the predicate in the body. Predicates
+    /// that are not registered relations are indexed as well
+    RuleIndex m_bodies;
+    unsigned m_numRules;
     Expr m_query;
     std::map<Expr, ExprVector> m_constraints;
     
-    const ExprVector &getVars () const;
+    /// predicates applied in the body of the rule
+    void bodyRelations (const HornRule &rule, ExprSet &out) const;
+    /// live rules among ids
+    RuleIdVector live (const RuleIndex &idx, Expr fdecl) const;
     
   public:
 
-    HornClauseDB (ExprFactory &efac) : m_efac (efac) {}
+    HornClauseDB (ExprFactory &efac) : m_efac (efac), m_numRules (0) {}
+    
+    ExprFactory &getExprFactory () const {return m_efac;}
     
-    void registerRelation (Expr fdecl) {m_rels.push_back (fdecl);}
+    void registerRelation (Expr fdecl);
     const ExprVector& getRelations () const {return m_rels;}
-    bool hasRelation (Expr fdecl) const
-    {return std::find
-        (m_rels.begin (), m_rels.end (), fdecl) != m_rels.end ();}
+    bool hasRelation (Expr fdecl) const {return m_relSet.count (fdecl) > 0;}
     
     
     template <typename Range>
     void addRule (const Range &vars, Expr rule)
     {
       if (isOpX<TRUE> (rule)) return;
-      m_rules.push_back (HornRule (vars, rule));
-      boost::copy (vars, std::back_inserter (m_vars));
-    }
-
-    void addRule (HornRule rule)
-    {
-      m_rules.push_back (rule);
-      boost::copy (rule.vars (), std::back_inserter (m_vars));
+      addRule (HornRule (vars, rule));
     }
 
-    void removeRule (const HornRule &r)
-    { m_rules.erase (std::remove (m_rules.begin(), m_rules.end(), r)); }
+    RuleId addRule (HornRule rule);
 
-    const RuleVector &getRules () const {return m_rules;}
-    RuleVector &getRules () {return m_rules;}
+    /// removes the rule with a given id 
+    void removeRule (RuleId id);
+    /// removes all live rules equal to r
+    void removeRule (const HornRule &r);
+    
+    /// live rules, in the order they were added
+    RuleRange getRules () const 
+    {return boost::adaptors::filter (m_rules, IsLive ());}
+    /// ids of the live rules
+    RuleIdVector getRuleIds () const;
+    const HornRule &getRule (RuleId id) const {return m_rules [id];}
+    bool isRemoved (RuleId id) const {return !m_rules [id].head ();}
+    /// number of live rules
+    unsigned numRules () const {return m_numRules;}
+    
+    /// ids of the rules whose head is an application of fdecl
+    RuleIdVector getHeadRules (Expr fdecl) const {return live (m_heads, fdecl);}
+    /// ids of the rules whose body applies fdecl
+    RuleIdVector getBodyRules (Expr fdecl) const {return live (m_bodies, fdecl);}
+    
+    /// variables of the live rules
+    const ExprSet &getVars () const {return m_vars;}
 
+    /// removes all relations, rules, constraints and the query
+    void reset ();
+    /// appends the relations, rules and constraints of o. The query
+    /// of o, if any, replaces the current one
+    void merge (const HornClauseDB &o);
+    
     void addQuery (Expr q) {m_query = q;}
     Expr getQuery () const {return m_query;}
     bool hasQuery () const {return m_query.get () != nullptr;}
@@ -145,6 +212,22 @@ namespace seahorn
 
     raw_ostream& write (raw_ostream& o) const;
 
+    /// Saves the database to a binary file (see ExprSerialize.hh)
+    bool save (StringRef file) const;
+    /// Replaces the content of the database by the content of a file
+    /// written by save (). LLVM values are mapped back by resolver,
+    /// if one is given. Returns false if the file cannot be read
+    bool load (StringRef file, const ExprValueResolver *resolver = nullptr);
+    
+    /// Appends the database to words. Its expressions are added to
+    /// w, whose section must precede the words
+    void save (ExprWriter &w, std::vector<uint32_t> &words) const;
+    /// Replaces the content of the database by the one stored at p,
+    /// with expressions from r. Returns the first word after it, or
+    /// NULL if the words are malformed
+    const uint32_t *load (const ExprReader &r, 
+                          const uint32_t *p, const uint32_t *end);
+
     /// load current HornClauseDB to a given FixedPoint object
     template <typename FP>
     void loadZFixedPoint (FP &fp,
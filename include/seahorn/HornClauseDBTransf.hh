@@ -9,6 +9,29 @@ namespace seahorn
   // Ensure all horn clause heads have only variables
   void normalizeHornClauseHeads (HornClauseDB &db);
 
+  /// A relation replaced by slicing: the new relation and the
+  /// positions of the arguments that it keeps
+  struct SlicedRelation
+  {
+    Expr fdecl;
+    std::vector<unsigned> kept;
+  };
+  typedef std::map<Expr, SlicedRelation> SliceMap;
+  
+  /// Cone-of-influence slicing w.r.t. the query. Removes the rules
+  /// that cannot reach the query and the arguments of relations that
+  /// cannot influence it, and projects the constraints of the
+  /// remaining relations on the arguments that are kept. A relation
+  /// that loses arguments is replaced by a relation of the same name;
+  /// sliced maps it to its replacement
+  void sliceHornClauseDB (HornClauseDB &db, SliceMap &sliced);
+
+  /// Orders the variables of every rule, and the arguments of the
+  /// conjunctions, disjunctions, sums and products in its head and
+  /// body, by ExprOrder. The database then does not depend on the
+  /// order in which its nodes were created. Rules keep their order
+  void canonicalizeHornClauseDB (HornClauseDB &db);
+
 }
 
 
@@ -6,6 +6,7 @@
 #include "boost/logic/tribool.hpp"
 
 #include "ufo/Smt/EZ3.hh"
+#include "seahorn/HornClauseDBTransf.hh"
 
 namespace seahorn
 {
@@ -15,10 +16,19 @@ namespace seahorn
   {
     boost::tribool m_result;
     std::unique_ptr<ufo::ZFixedPoint <ufo::EZ3> >  m_fp;
+    /// relations replaced by slicing (-horn-slice)
+    SliceMap m_sliced;
     
     
+    /// invariant of the predicate of a block, or NULL
+    Expr getInvariant (const BasicBlock &BB);
     void printInvars (Function &F);
     void printInvars (Module &M);
+    /// adds the still inductive invariants of -horn-inv-store as
+    /// constraints of the Horn clauses
+    void loadInvars (Module &M);
+    /// writes the invariants of the current proof to -horn-inv-store
+    void saveInvars (Module &M);
     void printCex ();
     
   public:
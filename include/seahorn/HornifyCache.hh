@@ -0,0 +1,61 @@
+#ifndef __HORNIFY_CACHE__HH_
+#define __HORNIFY_CACHE__HH_
+
+/**
+ * On-disk cache of the encoding of individual functions.
+
+ * An entry holds the clauses of a function, the live symbols of its
+ * blocks and its summary. Entries are files named by a key that the
+ * caller computes from everything the encoding depends on, so a
+ * function whose key did not change can be replayed instead of being
+ * encoded again. Expressions are stored with the format of
+ * ExprSerialize.hh.
+ */
+
+#include "seahorn/HornClauseDB.hh"
+#include "seahorn/SymExec.hh"
+#include "seahorn/ExprSerialize.hh"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/BasicBlock.h"
+
+namespace seahorn
+{
+  using namespace expr;
+
+  /// Encoding of a single function
+  struct HornifyCacheEntry
+  {
+    /// clauses of the function
+    HornClauseDB db;
+    /// live symbols at the entry of each block, in order
+    std::vector<std::pair<const llvm::BasicBlock*, ExprVector> > live;
+    /// true if the function has a summary
+    bool hasInfo;
+    FunctionInfo info;
+
+    HornifyCacheEntry (ExprFactory &efac) : db (efac), hasInfo (false) {}
+  };
+
+  class HornifyCache
+  {
+    std::string m_dir;
+
+    std::string path (llvm::StringRef key) const;
+
+  public:
+    explicit HornifyCache (llvm::StringRef dir) : m_dir (dir.str ()) {}
+
+    /// Key of the given description of an encoding
+    static std::string key (llvm::StringRef desc);
+
+    /// Reads the entry of key. Returns false if there is no valid
+    /// entry, or if some of its values do not resolve
+    bool load (llvm::StringRef key, const ExprValueResolver &resolver,
+               HornifyCacheEntry &entry) const;
+    /// Stores the entry of key. Returns false if it cannot be stored
+    bool save (llvm::StringRef key, const HornifyCacheEntry &entry) const;
+  };
+}
+
+#endif
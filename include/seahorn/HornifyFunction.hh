@@ -3,6 +3,8 @@
 
 #include "seahorn/HornifyModule.hh"
 #include "llvm/IR/Function.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
 
 #include "ufo/Expr.hpp"
 #include "ufo/Smt/EZ3.hh"
@@ -43,6 +45,14 @@ namespace seahorn
     
 
     void extractFunctionInfo (const BasicBlock &BB);
+    
+    /// true if bb has a predicate in the encoding of its function
+    virtual bool hasPredicate (const BasicBlock &bb) {return true;}
+    
+    /// adds the rules from the blocks with a predicate to the exit
+    /// when the error flag is set, and the query of main or the rules
+    /// of the summary of F
+    void addExitRules (const Function &F, const BasicBlock &exit);
   public:
     HornifyFunction (HornifyModule &parent, bool interproc = false) :
       m_parent (parent), m_sem (m_parent.symExec ()), 
@@ -53,6 +63,8 @@ namespace seahorn
     virtual ~HornifyFunction () {}
     HornClauseDB &getHornClauseDB () {return m_db;}
     virtual void runOnFunction (Function &F) = 0;
+    /// true if the side conditions of rules are sliced (-horn-slice-side)
+    static bool slicesSide ();
     // bool checkProperty(ExprVector prop, Expr &inv);
   };
 
@@ -69,12 +81,67 @@ namespace seahorn
   } ;
   
 
+  /// Small-step encoding with fused blocks. Only the entry, the exit
+  /// and the blocks without a unique predecessor have a predicate.
+  /// Every other block is fused into the rules of its predecessor,
+  /// so linear chains and the arms of diamonds need no predicates.
+  /// The arms of a non-branching diamond are merged into a single
+  /// path, so its join needs no predicate either
+  class MediumHornifyFunction : public HornifyFunction
+  {
+    /// exit block of the current function
+    const BasicBlock *m_exit;
+    
+    /// the join of each non-branching diamond, by its head
+    DenseMap<const BasicBlock*, const BasicBlock*> m_joins;
+    /// the joins of m_joins
+    SmallPtrSet<const BasicBlock*, 16> m_merged;
+    
+    /// finds the non-branching diamonds of F. A diamond is
+    /// non-branching if each of its arms is a chain of blocks with a
+    /// single predecessor and a single successor, and its join has
+    /// no other predecessor
+    void findDiamonds (const Function &F);
+    
+    /// true if bb has a predicate
+    bool isAnchor (const BasicBlock &bb);
+    bool hasPredicate (const BasicBlock &bb) override {return isAnchor (bb);}
+    
+    /// adds the rules of all paths that start at the anchor of pre
+    /// and continue from bb through non-anchor blocks. s and side
+    /// hold the state and the constraints of the path at the entry
+    /// of bb, and are consumed
+    void fuse (const BasicBlock &bb, Expr pre, Expr err, 
+               SymStore &s, ExprVector &side);
+    
+    /// executes every arm of the diamond from head to join on a copy
+    /// of the path at the entry of head, and merges them into the
+    /// path at the entry of join. The values that differ between the
+    /// arms are merged into fresh constants, and side gets the
+    /// disjunction of the arms
+    void mergeDiamond (const BasicBlock &head, const BasicBlock &join,
+                       Expr pre, Expr err, SymStore &s, ExprVector &side);
+    
+    /// adds the rule pre & side -> post
+    void addPathRule (Expr pre, ExprVector &side, Expr post);
+    
+  public:
+    MediumHornifyFunction (HornifyModule &parent, 
+                           bool interproc = false) : 
+      HornifyFunction (parent, interproc), m_exit (NULL) {}
+    
+    virtual void runOnFunction (Function &F);
+  };
+
   class LargeHornifyFunction : public HornifyFunction
   {
+    /// whether paths are merged at join points (UfoMergeSymExec)
+    bool m_merge;
+    
   public:
     LargeHornifyFunction (HornifyModule &parent, 
-                          bool interproc = false) : 
-      HornifyFunction (parent, interproc) {}
+                          bool interproc = false, bool merge = false) : 
+      HornifyFunction (parent, interproc), m_merge (merge) {}
     
     virtual void runOnFunction (Function &F);
   };
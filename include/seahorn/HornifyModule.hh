@@ -3,6 +3,7 @@
 
 #include "llvm/Pass.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Analysis/CallGraph.h"
 
 #include "ufo/Expr.hpp"
 #include "ufo/Smt/EZ3.hh"
@@ -10,10 +11,14 @@
 #include "seahorn/ClpSymExec.hh"
 
 #include "boost/smart_ptr/scoped_ptr.hpp"
+#include "boost/ptr_container/ptr_vector.hpp"
+
+#include <mutex>
 
 #include "seahorn/LiveSymbols.hh"
 
 #include "seahorn/HornClauseDB.hh"
+#include "seahorn/HornifyCache.hh"
 
 namespace seahorn
 {
@@ -37,14 +42,50 @@ namespace seahorn
     
     LiveSymbolsMap m_ls;
     PredDeclMap m_bbPreds;
+    /// true if the clauses were loaded with -horn-load-db
+    bool m_loaded;
+    /// guards m_bbPreds while functions are encoded in parallel
+    mutable std::mutex m_bbPredsLock;
+    
+    /// encoding context of a function that is encoded by a worker
+    /// thread: its own copy of the symbolic execution engine, and
+    /// the database that receives its clauses
+    struct Context
+    {
+      SmallStepSymExec *sem;
+      HornClauseDB *db;
+    };
+    /// context of the current worker thread, or NULL
+    static thread_local Context *s_ctx;
+    /// engines of the worker contexts. Live symbols keep a reference
+    /// to them
+    boost::ptr_vector<SmallStepSymExec> m_ctxSems;
+    
+    /// cache of the encoding of functions (-horn-cache-dir), or NULL
+    boost::scoped_ptr<HornifyCache> m_cache;
+    boost::scoped_ptr<ExprValueResolver> m_resolver;
+    
+    SmallStepSymExec *cloneSymExec () const;
+    /// encodes F. Live symbols of F must be allocated
+    void encodeFunction (Function &F);
+    /// encodes F, or replays its encoding from the cache
+    void encodeFunctionCached (Function &F);
+    /// cache key of the encoding of F
+    std::string cacheKey (const Function &F);
+    /// encodes call graph SCCs in waves of independent SCCs
+    bool runParallel (Module &M, CallGraph &CG);
     
   public:
     static char ID;
     HornifyModule ();
-    virtual ~HornifyModule () {}
+    /// -- terms are released in bulk rather than node by node
+    virtual ~HornifyModule () { m_efac.bulkRelease (); }
     ExprFactory& getExprFactory () {return m_efac;} 
     EZ3 &getZContext () {return m_zctx;}
-    HornClauseDB& getHornClauseDB () {return m_db;}
+    HornClauseDB& getHornClauseDB () {return s_ctx ? *s_ctx->db : m_db;}
+    /// -- true if the clauses were loaded rather than encoded. Blocks
+    /// -- have no predicates and no live symbols then
+    bool isLoaded () const {return m_loaded;}
     virtual bool runOnModule (Module &M);
     virtual bool runOnFunction (Function &F);
     virtual void getAnalysisUsage (AnalysisUsage &AU) const;
@@ -61,7 +102,10 @@ namespace seahorn
     const ExprVector &live (const BasicBlock *bb) const 
     {assert (bb != NULL); return live (*bb);}
     bool hasBbPredicate (const BasicBlock &BB) const
-    {return m_bbPreds.count (&BB);} 
+    {
+      std::lock_guard<std::mutex> lock (m_bbPredsLock);
+      return m_bbPreds.count (&BB);
+    } 
     /// -- predicate declaration for the given basic block
     const Expr bbPredicate (const BasicBlock &bb);
     /// --- BasicBlock corresponding to the predicate
@@ -73,7 +117,7 @@ namespace seahorn
         m_sem->getFunctionInfo (F).sumPred : Expr(0);
     }
     /// -- symbolic execution engine
-    SmallStepSymExec &symExec () {return *m_sem;}
+    SmallStepSymExec &symExec () {return s_ctx ? *s_ctx->sem : *m_sem;}
     
     CutPointGraph &getCpg (Function &F)
     {return getAnalysis<CutPointGraph> (F);}
@@ -0,0 +1,65 @@
+#ifndef __INVARIANT_STORE__HH_
+#define __INVARIANT_STORE__HH_
+
+/**
+ * Persistent store of the invariants of basic blocks.
+
+ * The invariants of a block are lemmas over its live symbols. They
+ * are keyed by a hash of the IR of the block, so that a later run on
+ * a slightly different module can use them as candidates. Candidates
+ * are not trusted: validateInvariants () keeps only the ones that are
+ * inductive for the current Horn clauses.
+ */
+
+#include "seahorn/HornClauseDB.hh"
+#include "seahorn/ExprSerialize.hh"
+#include "ufo/Smt/EZ3.hh"
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/IR/BasicBlock.h"
+
+#include <map>
+
+namespace seahorn
+{
+  using namespace expr;
+
+  class InvariantStore
+  {
+    /// key of a block -> lemmas over its live symbols
+    std::map<std::string, ExprVector> m_invs;
+
+  public:
+    /// key of a block: a hash of its function name, its name and its
+    /// instructions
+    static std::string key (const llvm::BasicBlock &bb);
+
+    /// lemmas of the block with the given key, or NULL
+    const ExprVector *get (const std::string &key) const
+    {
+      auto it = m_invs.find (key);
+      return it == m_invs.end () ? nullptr : &it->second;
+    }
+    void set (const std::string &key, const ExprVector &lemmas)
+    { m_invs [key] = lemmas; }
+    void clear () { m_invs.clear (); }
+    size_t size () const { return m_invs.size (); }
+
+    /// Replaces the content of the store by the content of a file
+    /// written by save (). Returns false if the file cannot be read
+    bool load (llvm::StringRef file, ExprFactory &efac,
+               const ExprValueResolver &resolver);
+    /// Saves the store. Lemmas that cannot be serialized are dropped
+    bool save (llvm::StringRef file) const;
+  };
+
+  /// Removes from invs the lemmas that are not inductive. invs maps a
+  /// relation of db to lemmas over the bound variables of its
+  /// arguments (as in HornClauseDB::addConstraint). On return, every
+  /// lemma of a rule head is implied by the rule and the lemmas of its
+  /// body. Lemmas whose check is not conclusive are removed
+  void validateInvariants (const HornClauseDB &db, ufo::EZ3 &zctx,
+                           std::map<Expr, ExprVector> &invs);
+}
+
+#endif
@@ -4,6 +4,7 @@
   
 #include "llvm/IR/Function.h"
 #include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/BitVector.h"
 
 #include "ufo/Expr.hpp"
 #include "seahorn/SymStore.hh"
@@ -16,45 +17,26 @@ namespace seahorn
   
 
   
+  /// Live information of a basic block. Sets of symbols are bit
+  /// vectors over the numbering of the symbols by LiveSymbols
   class LiveInfo
   {
-    ExprVector m_live;
-    ExprVector m_defs;
-    llvm::SmallVector<ExprVector, 16> m_edgeDefs;
+    friend class LiveSymbols;
     
-  public:
-    
-    LiveInfo () {}
-    LiveInfo (const LiveInfo &o) :
-      m_live (o.m_live), m_defs (o.m_defs), 
-      m_edgeDefs (o.m_edgeDefs) {}
-    
-    
-    LiveInfo &operator= (LiveInfo o)
-    {
-      std::swap (m_live, o.m_live);
-      std::swap (m_defs, o.m_defs);
-      std::swap (m_edgeDefs, o.m_edgeDefs);
-      return *this;
-    }
+    BitVector m_live;
+    BitVector m_defs;
+    llvm::SmallVector<BitVector, 2> m_edgeDefs;
     
+    /// m_live as a vector of symbols sorted by ExprOrder. Built on demand
+    mutable ExprVector m_liveExprs;
+    mutable bool m_dirty;
     
-    void setLive (const ExprVector &l);
-    void setDefs (const ExprVector &d);
-    void addEdgeDef (const ExprVector &d);
-    /// add live variables. These should not be already live
-    void addLive (ExprVector &v);
-    /// like addLive but v can contain variables already live
-    void unionLive (ExprVector &v);
-    
-    
-    const ExprVector& live () const { return m_live; }
-    const ExprVector& defs () const { return m_defs; }
-    const ExprVector& edge_defs (unsigned i) const 
-    {
-      return m_edgeDefs[i];
-    }
+  public:
+    LiveInfo () : m_dirty (true) {}
     
+    const BitVector& live () const { return m_live; }
+    const BitVector& defs () const { return m_defs; }
+    const BitVector& edge_defs (unsigned i) const { return m_edgeDefs[i]; }
   };
   
 
@@ -74,6 +56,19 @@ namespace seahorn
     DenseMap<const BasicBlock*, LiveInfo> m_liveInfo;
     Expr trueE;
     
+    /// symbols used or defined in the function, numbered densely
+    ExprVector m_symbols;
+    DenseMap<const ENode*, unsigned> m_symbolIdx;
+    /// true if the numbering agrees with ExprOrder
+    bool m_sorted;
+    
+    /// the number of v. Numbers v if it is new
+    unsigned symbolIdx (Expr v);
+    /// the set of symbols in v
+    BitVector toBits (const ExprVector &v);
+    /// v becomes a set of m_symbols.size () bits
+    void resize (BitVector &v) const 
+    { if (v.size () < m_symbols.size ()) v.resize (m_symbols.size ()); }
    
     void symExec (SymStore &s, const BasicBlock &bb);
     void symExecPhi (SymStore &s, const BasicBlock &bb, const BasicBlock &from);
@@ -88,20 +83,28 @@ namespace seahorn
   public:
     LiveSymbols (const Function &F, ExprFactory &efac, 
                  SmallStepSymExec &semantics) : 
-      m_f (F), m_efac (efac), m_semantics (semantics), m_gstore (efac)
+      m_f (F), m_efac (efac), m_semantics (semantics), m_gstore (efac),
+      m_sorted (true)
     { trueE = mk<TRUE> (m_efac); }
     
     LiveSymbols (const LiveSymbols &o) : 
       m_f(o.m_f), m_efac (o.m_efac), m_semantics (o.m_semantics),
       m_side(), m_rtopo (o.m_rtopo), m_gstore(o.m_gstore), m_liveInfo(o.m_liveInfo),
-      trueE(o.trueE) {}
+      trueE(o.trueE), m_symbols (o.m_symbols), m_symbolIdx (o.m_symbolIdx),
+      m_sorted (o.m_sorted) {}
     
     
     void run ();
     void operator() () { run (); }
     /// Add additional globally live symbols
     void globallyLive (ExprVector &live);
+    /// live symbols at the entry of bb. Sorted, unless they were set
+    /// by setLive ()
     const ExprVector& live (const BasicBlock *bb) const;
+    /// Sets the live symbols at the entry of bb, in the given order,
+    /// instead of computing them with run (). The order is kept since
+    /// it is the order of the arguments of the predicate of bb
+    void setLive (const BasicBlock *bb, const ExprVector &live);
     void dump () const;
     
   };
@@ -0,0 +1,248 @@
+#ifndef __PERSISTENT_MAP_HH_
+#define __PERSISTENT_MAP_HH_
+
+/**
+ * A persistent ordered map.
+
+ * The map is a treap whose nodes are immutable and reference
+ * counted. Copying a map copies the pointer to its root, and an update
+ * copies only the O(log n) nodes on the path to the updated key. The
+ * copies share all other nodes, so a sequence of snapshots costs
+ * memory proportional to the updates between them.
+
+ * The priority of a node is a hash of its key, so the shape of the
+ * tree depends only on the keys it contains. Reference counts are not
+ * atomic: maps that share nodes must be used by a single thread.
+ */
+
+#include <boost/functional/hash.hpp>
+#include <boost/intrusive_ptr.hpp>
+
+#include <stdint.h>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+namespace seahorn
+{
+  template <typename K, typename V,
+            typename Compare = std::less<K>,
+            typename Hash = boost::hash<K> >
+  class PersistentMap
+  {
+  public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<const K,V> value_type;
+
+  private:
+    struct Node
+    {
+      mutable unsigned m_count;
+      value_type m_value;
+      size_t m_prio;
+      boost::intrusive_ptr<const Node> m_left;
+      boost::intrusive_ptr<const Node> m_right;
+
+      Node (const K &k, const V &v, size_t prio,
+            const boost::intrusive_ptr<const Node> &left,
+            const boost::intrusive_ptr<const Node> &right) :
+        m_count (0), m_value (k, v), m_prio (prio),
+        m_left (left), m_right (right) {}
+
+      friend void intrusive_ptr_add_ref (const Node *n) { ++n->m_count; }
+      friend void intrusive_ptr_release (const Node *n)
+      { if (--n->m_count == 0) delete n; }
+    };
+    typedef boost::intrusive_ptr<const Node> NodePtr;
+
+    NodePtr m_root;
+    size_t m_size;
+    Compare m_cmp;
+    Hash m_hash;
+
+    /// mixes the bits of a hash so that keys that are ordered by
+    /// address do not get ordered priorities
+    static size_t mix (size_t h)
+    {
+      uint64_t x = h;
+      x ^= x >> 33;
+      x *= 0xff51afd7ed558ccdULL;
+      x ^= x >> 33;
+      x *= 0xc4ceb9fe1a85ec53ULL;
+      x ^= x >> 33;
+      return static_cast<size_t> (x);
+    }
+
+    static NodePtr copy (const Node *n, const NodePtr &left, const NodePtr &right)
+    {
+      return NodePtr (new Node (n->m_value.first, n->m_value.second,
+                                n->m_prio, left, right));
+    }
+
+    NodePtr insert (const NodePtr &t, const K &k, const V &v, size_t prio,
+                    bool &added) const
+    {
+      if (!t)
+      {
+        added = true;
+        return NodePtr (new Node (k, v, prio, NodePtr (), NodePtr ()));
+      }
+
+      if (m_cmp (k, t->m_value.first))
+      {
+        NodePtr l = insert (t->m_left, k, v, prio, added);
+        // -- rotate right
+        if (l->m_prio > t->m_prio)
+          return copy (l.get (), l->m_left, copy (t.get (), l->m_right, t->m_right));
+        return copy (t.get (), l, t->m_right);
+      }
+
+      if (m_cmp (t->m_value.first, k))
+      {
+        NodePtr r = insert (t->m_right, k, v, prio, added);
+        // -- rotate left
+        if (r->m_prio > t->m_prio)
+          return copy (r.get (), copy (t.get (), t->m_left, r->m_left), r->m_right);
+        return copy (t.get (), t->m_left, r);
+      }
+
+      return NodePtr (new Node (k, v, t->m_prio, t->m_left, t->m_right));
+    }
+
+    static NodePtr merge (const NodePtr &a, const NodePtr &b)
+    {
+      if (!a) return b;
+      if (!b) return a;
+      if (a->m_prio > b->m_prio)
+        return copy (a.get (), a->m_left, merge (a->m_right, b));
+      return copy (b.get (), merge (a, b->m_left), b->m_right);
+    }
+
+    NodePtr erase (const NodePtr &t, const K &k, bool &erased) const
+    {
+      if (!t) return t;
+
+      if (m_cmp (k, t->m_value.first))
+      {
+        NodePtr l = erase (t->m_left, k, erased);
+        return erased ? copy (t.get (), l, t->m_right) : t;
+      }
+      if (m_cmp (t->m_value.first, k))
+      {
+        NodePtr r = erase (t->m_right, k, erased);
+        return erased ? copy (t.get (), t->m_left, r) : t;
+      }
+
+      erased = true;
+      return merge (t->m_left, t->m_right);
+    }
+
+  public:
+    /// in-order iterator over the entries
+    class const_iterator :
+      public std::iterator<std::forward_iterator_tag, const value_type>
+    {
+      friend class PersistentMap;
+      /// path from the root to the current node, excluding nodes
+      /// whose left subtree is being visited
+      std::vector<const Node*> m_stack;
+
+      void pushLeft (const Node *n)
+      {
+        for (; n; n = n->m_left.get ()) m_stack.push_back (n);
+      }
+
+    public:
+      const_iterator () {}
+
+      const value_type &operator* () const { return m_stack.back ()->m_value; }
+      const value_type *operator-> () const { return &m_stack.back ()->m_value; }
+
+      const_iterator &operator++ ()
+      {
+        const Node *n = m_stack.back ();
+        m_stack.pop_back ();
+        pushLeft (n->m_right.get ());
+        return *this;
+      }
+      const_iterator operator++ (int)
+      {
+        const_iterator res (*this);
+        ++*this;
+        return res;
+      }
+
+      bool operator== (const const_iterator &o) const
+      {
+        if (m_stack.empty () || o.m_stack.empty ())
+          return m_stack.empty () == o.m_stack.empty ();
+        return m_stack.back () == o.m_stack.back ();
+      }
+      bool operator!= (const const_iterator &o) const { return !(*this == o); }
+    };
+    typedef const_iterator iterator;
+
+    PersistentMap () : m_size (0) {}
+
+    size_t size () const { return m_size; }
+    bool empty () const { return m_size == 0; }
+
+    /// the value of k, or NULL if k is not in the map
+    const V *lookup (const K &k) const
+    {
+      const Node *n = m_root.get ();
+      while (n)
+      {
+        if (m_cmp (k, n->m_value.first)) n = n->m_left.get ();
+        else if (m_cmp (n->m_value.first, k)) n = n->m_right.get ();
+        else return &n->m_value.second;
+      }
+      return NULL;
+    }
+
+    size_t count (const K &k) const { return lookup (k) ? 1 : 0; }
+
+    /// maps k to v, replacing the previous value of k if there is one
+    void set (const K &k, const V &v)
+    {
+      bool added = false;
+      m_root = insert (m_root, k, v, mix (m_hash (k)), added);
+      if (added) ++m_size;
+    }
+
+    /// removes k. Returns the number of removed entries
+    size_t erase (const K &k)
+    {
+      bool erased = false;
+      m_root = erase (m_root, k, erased);
+      if (!erased) return 0;
+      --m_size;
+      return 1;
+    }
+
+    void clear ()
+    {
+      m_root.reset ();
+      m_size = 0;
+    }
+
+    void swap (PersistentMap &o)
+    {
+      m_root.swap (o.m_root);
+      std::swap (m_size, o.m_size);
+    }
+
+    const_iterator begin () const
+    {
+      const_iterator it;
+      it.pushLeft (m_root.get ());
+      return it;
+    }
+    const_iterator end () const { return const_iterator (); }
+  };
+}
+
+#endif
@@ -48,6 +48,23 @@ namespace seahorn
   };
   /// maps llvm::Function to seahorn::FunctionInfo
   typedef DenseMap<const llvm::Function*, FunctionInfo> FuncInfoMap;
+  
+  /// Parametric transition relation of a basic block or of the
+  /// phi-nodes of a CFG edge. Recorded once on an empty store, and
+  /// instantiated on a store by renaming the recorded values
+  struct SymTransition
+  {
+    /// reads and havocs in execution order
+    SymStore::OpLog ops;
+    /// side condition over the recorded values
+    ExprVector side;
+    /// activation literal used when recording, or NULL
+    Expr act;
+    
+    /// Replays the transition on s, and adds its side condition,
+    /// conditioned on act, to side
+    void apply (SymStore &s, ExprVector &side, Expr act) const;
+  };
 
   class SmallStepSymExec
   {
@@ -59,18 +76,48 @@ namespace seahorn
     Expr falseE;
     Expr m_errorFlag;
     
+    /// (bb, NULL) for a block, (bb, from) for the phi-nodes of an edge
+    typedef std::pair<const BasicBlock*, const BasicBlock*> TransitionKey;
+    typedef DenseMap<TransitionKey, SymTransition> TransitionMap;
+    /// transitions recorded with a true activation literal
+    TransitionMap m_trueTrans;
+    /// transitions recorded with m_transAct as the activation literal
+    TransitionMap m_actTrans;
+    Expr m_transAct;
+    
+    /// Executes bb, or the phi-nodes of the (from,bb)-edge if from is
+    /// not NULL, through a cached transition that is recorded by
+    /// execUncached on first use
+    void execTransition (SymStore &s, const BasicBlock &bb,
+                         const BasicBlock *from, ExprVector &side, Expr act);
+    
+    /// Executes bb, or the phi-nodes of the (from,bb)-edge if from is
+    /// not NULL, without the transition cache
+    virtual void execUncached (SymStore &s, const BasicBlock &bb,
+                               const BasicBlock *from,
+                               ExprVector &side, Expr act)
+    {
+      if (from) execPhi (s, bb, *from, side, act);
+      else exec (s, bb, side, act);
+    }
+    
   public:
     SmallStepSymExec (ExprFactory &efac) : 
       m_efac (efac), 
       trueE (mk<TRUE> (m_efac)),
       falseE (mk<FALSE> (m_efac)),
-      m_errorFlag (bind::boolConst (mkTerm<std::string> ("error.flag", m_efac))) {}
+      m_errorFlag (bind::boolConst (mkTerm<std::string> ("error.flag", m_efac))),
+      m_transAct (bind::boolConst (mkTerm<std::string> ("sym.transition.act",
+                                                       m_efac))) {}
     
      
     SmallStepSymExec (const SmallStepSymExec &o) : 
       m_efac (o.m_efac), 
       m_fmap (o.m_fmap),
-      m_errorFlag (o.m_errorFlag) {}
+      trueE (o.trueE),
+      falseE (o.falseE),
+      m_errorFlag (o.m_errorFlag),
+      m_transAct (o.m_transAct) {}
     
     virtual ~SmallStepSymExec () {}
     
@@ -3,9 +3,13 @@
 /// A symbolic store is a map from symbolic registers to symbolic values.
 
 #include "ufo/Expr.hpp"
+#include "seahorn/Support/PersistentMap.hh"
 
 #include "llvm/Support/raw_ostream.h"
 
+#include <boost/unordered_map.hpp>
+#include <iterator>
+
 namespace seahorn
 {
   using namespace expr;
@@ -41,7 +45,19 @@ namespace seahorn
     
   public:
     typedef boost::shared_ptr<SymStore> SymStorePtr;
-    typedef std::map<Expr,Expr> ExprExprMap;
+    /// persistent, so that copies of a store are O(1) and share
+    /// their entries
+    typedef PersistentMap<Expr,Expr> ExprExprMap;
+    
+    /// A read () or havoc () of key that returned val
+    struct Op
+    {
+      bool havoc;
+      Expr key;
+      Expr val;
+      Op (bool h, Expr k, Expr v) : havoc (h), key (k), val (v) {}
+    };
+    typedef std::vector<Op> OpLog;
     
   protected:
     /// Parent store, if any
@@ -62,6 +78,26 @@ namespace seahorn
     size_t m_defs_sz;
     
     detail::SymStoreEvalVisitor m_evalVisitor;
+    /// results of eval (), created on first use. Valid until a key
+    /// that eval () has visited is written. It holds its keys, so that
+    /// the many short-lived stores are not registered with the factory
+    boost::scoped_ptr<DagVisitMemo> m_evalMemo;
+    
+    /// -- used by a store without a parent only
+    /// current version of each key
+    boost::unordered_map<Expr,unsigned> m_version;
+    /// versions of each key built so far, indexed by version number.
+    /// Kept across reset () so that each version is built once
+    boost::unordered_map<Expr,ExprVector> m_variants;
+    
+    /// version idx of key. Sets it as the current version
+    Expr newVersion (Expr key, unsigned idx);
+    
+    /// when set, read () and havoc () of non-values are appended to it
+    OpLog *m_log;
+    
+    /// definitions of values, see define ()
+    ExprExprMap m_valueDefs;
     
   public:
     /// Create a SymStore with a given parent store. This store
@@ -71,13 +107,13 @@ namespace seahorn
     SymStore (SymStore &parent, bool trackUse) : 
       m_Parent (&parent), m_efac (m_Parent->getExprFactory ()), m_trackUse (trackUse), 
       m_uses (), m_defs (), m_defs_sz (m_defs.size ()),
-      m_evalVisitor (*this) {}
+      m_evalVisitor (*this), m_log (NULL) {}
     
     /// Create a SymStore. If globalParent is true, the created store has no parent.
     SymStore (ExprFactory &efac, bool trackUse = false, bool globalParent = false) : 
       m_Parent(NULL), m_efac (efac), m_trackUse (trackUse),       
       m_uses (), m_defs (), m_defs_sz (m_defs.size ()),
-      m_evalVisitor (*this) 
+      m_evalVisitor (*this), m_log (NULL)
     {
       if (!globalParent)
       {
@@ -94,7 +130,9 @@ namespace seahorn
       m_efac (other.m_efac),
       m_trackUse (other.m_trackUse),
       m_uses (other.m_uses), m_defs (other.m_defs), m_defs_sz (other.m_defs_sz),
-      m_evalVisitor (*this) // create new m_evalVisitor
+      m_evalVisitor (*this), // create new m_evalVisitor
+      m_version (other.m_version), m_variants (other.m_variants),
+      m_log (NULL), m_valueDefs (other.m_valueDefs)
     {}
     
     SymStore &operator= (SymStore other)
@@ -115,17 +153,37 @@ namespace seahorn
     
     Expr at (Expr key) const
     {
-      if (isDefined (key)) return m_Store.at (key);
-      return Expr(0);
+      const Expr *val = m_Store.lookup (key);
+      return val ? *val : Expr(0);
     }
     
-    Expr eval (Expr exp) { return expr::dagVisit (m_evalVisitor, exp); }
+    Expr eval (Expr exp)
+    {
+      if (!m_evalMemo) m_evalMemo.reset (new DagVisitMemo (m_efac, true));
+      return expr::visit (m_evalVisitor, exp, *m_evalMemo);
+    }
     Expr operator() (Expr exp) { return eval (exp); }
     
-    typedef ExprMap::iterator iterator;
-    typedef ExprMap::const_iterator const_iterator;
-    iterator begin () { return m_Store.begin (); }
-    iterator end () { return m_Store.end (); }
+    /// Evaluates every expression in r and writes the results to
+    /// out. The evaluations share one memo, so sub-expressions common
+    /// to several of them are evaluated once
+    template <typename Range, typename OutputIterator>
+    OutputIterator evalAll (const Range &r, OutputIterator out)
+    {
+      for (const Expr &e : r) *out++ = eval (e);
+      return out;
+    }
+    
+    template <typename Range>
+    ExprVector evalAll (const Range &r)
+    {
+      ExprVector res;
+      evalAll (r, std::back_inserter (res));
+      return res;
+    }
+    
+    typedef ExprExprMap::const_iterator iterator;
+    typedef ExprExprMap::const_iterator const_iterator;
     const_iterator begin () const { return m_Store.begin (); }
     const_iterator end () const { return m_Store.end (); }
    
@@ -136,6 +194,9 @@ namespace seahorn
       m_uses.clear ();
       m_defs.clear ();
       m_defs_sz = 0;
+      if (m_evalMemo) m_evalMemo->clear ();
+      m_version.clear ();
+      m_valueDefs.clear ();
       // if (m_ownedParent) m_ownedParent.reset (new SymStore (efac, false, true));
       if (m_ownedParent) m_ownedParent->reset ();
     }
@@ -150,6 +211,21 @@ namespace seahorn
     Expr havoc (Expr key);
     Expr read (Expr key);
     
+    /// Records that val, a value returned by this store, is equal to
+    /// def wherever val is used. Symbolic execution uses definitions to
+    /// simplify the terms it builds over val
+    void define (Expr val, Expr def) { m_valueDefs.set (val, def); }
+    /// the definition of val, or NULL
+    Expr definition (Expr val) const
+    {
+      const Expr *def = m_valueDefs.lookup (val);
+      return def ? *def : Expr (0);
+    }
+    
+    /// Records the reads and havocs of this store in log, or stops
+    /// recording if log is NULL. The log stays with this store on swap
+    void setLog (OpLog *log) { m_log = log; }
+    
     
   };
     
@@ -17,6 +17,12 @@ namespace seahorn
     const DataLayout *m_td;
     const CanFail *m_canFail;
     
+    bool isCacheable (const BasicBlock &bb);
+    
+  protected:
+    void execUncached (SymStore &s, const BasicBlock &bb,
+                       const BasicBlock *from,
+                       ExprVector &side, Expr act) override;
     
   public:
     UfoSmallSymExec (ExprFactory &efac, Pass &pass, TrackLevel trackLvl = MEM) : 
@@ -26,7 +32,8 @@ namespace seahorn
       m_canFail = pass.getAnalysisIfAvailable<CanFail> ();
     }
     UfoSmallSymExec (const UfoSmallSymExec& o) : 
-      SmallStepSymExec (o), m_pass (o.m_pass), m_trackLvl (o.m_trackLvl) {}
+      SmallStepSymExec (o), m_pass (o.m_pass), m_trackLvl (o.m_trackLvl),
+      m_td (o.m_td), m_canFail (o.m_canFail) {}
     
     Expr errorFlag (const BasicBlock &BB) override;
     
@@ -57,6 +64,21 @@ namespace seahorn
     unsigned fieldOff (const StructType *t, unsigned field);
     bool isShadowMem (const Value &V);
     
+    /// true if registers and memory are bit-vectors (-horn-bv)
+    bool isBv () const;
+    /// true if memory reads are resolved against the stores that
+    /// precede them (-horn-simplify-mem)
+    bool simplifiesMem () const;
+    /// true if constraints are not guarded by the activation literal
+    /// (-horn-global-constraints)
+    bool hasGlobalConstraints () const;
+    /// width of the bit-vector that represents a value of type t
+    unsigned bvWidth (const llvm::Type *t);
+    /// width of pointers and of memory words
+    unsigned ptrWidth () {return m_td->getPointerSizeInBits ();}
+    /// bit-vector numeral of k modulo 2^width
+    Expr bvNum (mpz_class k, unsigned width);
+    
   }; 
   
 
@@ -76,6 +98,25 @@ namespace seahorn
     
     
   };  
+  
+  /// Large step symbolic execution that merges paths at join points.
+  /// Each block of an edge is executed once, on the store merged from
+  /// its predecessors. A symbol with different values on the incoming
+  /// edges gets one fresh value, defined by an ITE over the edge
+  /// conditions. The store must delegate havoc () to a parent, as the
+  /// stores created by SymStore (efac) do, so that copies of it create
+  /// distinct values
+  class UfoMergeSymExec : public LargeStepSymExec
+  {
+    SmallStepSymExec &m_sem;
+    Expr trueE;
+    
+  public:
+    UfoMergeSymExec (SmallStepSymExec &sem)
+      : m_sem (sem) { trueE = mk<TRUE> (m_sem.getExprFactory ()); }
+    
+    virtual void execCpEdg (SymStore &s, const CpEdge &edge, ExprVector &side);
+  };
 }
 
 #endif
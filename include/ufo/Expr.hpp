@@ -11,7 +11,10 @@
 #include <iostream>
 #include <iomanip>
 #include <string>
+#include <atomic>
+#include <mutex>
 
+#include <stdint.h>
 #include <gmpxx.h>
 
 #define forall BOOST_FOREACH
@@ -19,6 +22,7 @@
 
 /** boost */
 #include <boost/shared_ptr.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <boost/intrusive_ptr.hpp>
 #include <boost/functional/hash.hpp>
 #include <boost/unordered_map.hpp>
@@ -32,6 +36,7 @@
 #include <boost/pool/pool.hpp>
 #include <boost/pool/pool_alloc.hpp>
 #include <boost/lexical_cast.hpp>
+#include <boost/iterator/iterator_adaptor.hpp>
 
 #include "llvm/ADT/SmallVector.h"
 
@@ -70,6 +75,71 @@ namespace expr
   inline ENode* eptr (Expr &e) { return e.get (); }
   //inline ENode* eptr (Expr e) { return e.get (); }
 
+  /**
+   * Children of an expression node. Up to INLINE children are stored
+   * inside the node, wider nodes fall back to the heap. Clearing keeps
+   * the storage, so that recycled nodes keep their buffers.
+   */
+  class ENodeArgs : boost::noncopyable
+  {
+  public:
+    enum { INLINE = 3 };
+
+    class const_iterator :
+      public boost::iterator_adaptor<const_iterator, ENode *const *>
+    {
+    public:
+      const_iterator () {}
+      explicit const_iterator (ENode *const *p) :
+	const_iterator::iterator_adaptor_ (p) {}
+    };
+    typedef const_iterator iterator;
+
+  private:
+    unsigned m_size;
+    unsigned m_capacity;
+    union
+    {
+      ENode *m_inline [INLINE];
+      ENode **m_heap;
+    };
+
+    bool isInline () const { return m_capacity == INLINE; }
+    ENode **data () { return isInline () ? m_inline : m_heap; }
+    ENode *const *data () const { return isInline () ? m_inline : m_heap; }
+
+    void grow ()
+    {
+      unsigned capacity = 2 * m_capacity;
+      ENode **heap = new ENode* [capacity];
+      std::copy (data (), data () + m_size, heap);
+      if (!isInline ()) delete [] m_heap;
+      m_heap = heap;
+      m_capacity = capacity;
+    }
+
+  public:
+    ENodeArgs () : m_size (0), m_capacity (INLINE) {}
+    ~ENodeArgs () { if (!isInline ()) delete [] m_heap; }
+
+    size_t size () const { return m_size; }
+    bool empty () const { return m_size == 0; }
+
+    const_iterator begin () const { return const_iterator (data ()); }
+    const_iterator end () const { return const_iterator (data () + m_size); }
+
+    ENode *operator[] (size_t i) const { return data () [i]; }
+
+    void push_back (ENode *a)
+    {
+      if (m_size == m_capacity) grow ();
+      data () [m_size++] = a;
+    }
+
+    /** removes all elements but keeps the storage */
+    void clear () { m_size = 0; }
+  };
+
   class Operator;
     
   /* An operator (a.k.a. a tag) of an expression node */
@@ -86,20 +156,26 @@ namespace expr
               -- might be ambiguous and brakets might be required
      **/
     virtual void Print (std::ostream &OS,
-			const std::vector<ENode*> &args,
+			const ENodeArgs &args,
 			int depth = 0, 
 			bool brkt = true) const = 0;
     virtual bool operator== (const Operator& rhs) const = 0;
     virtual bool operator< (const Operator& rhs) const = 0;
     virtual size_t hash () const = 0;
     virtual bool isMutable () const { return false; }
+    /* true if all instances of the operator are equal */
+    virtual bool isStateless () const { return false; }
     /* Returns a heap-allocated clone of this */
     virtual Operator* clone (ExprFactoryAllocator &allocator) const = 0;
+    /* Returns the operator to be stored in a node: a clone for
+       operators with data, and a shared instance for stateless ones */
+    virtual const Operator* intern (ExprFactoryAllocator &allocator) const
+    { return clone (allocator); }
   };
 
 
   inline std::ostream &operator<<(std::ostream &OS, const Operator &V) {
-    std::vector<ENode*> x;
+    ENodeArgs x;
     V.Print (OS, x);
     return OS;
   }
@@ -111,22 +187,30 @@ namespace expr
   {
   private:
     // // -- no default constructor
-    ENode () : id(0), count(0), fac(NULL) {}
+    ENode () : id(0), count(0), hval(0), fac(NULL), oper(NULL) {}
     // // -- no copy constructor
-    ENode (const ENode &) : count(0), fac(NULL) {}
+    ENode (const ENode &) : count(0), hval(0), fac(NULL), oper(NULL) {}
   protected:
     /** unique identifier of this expression node */
     unsigned int id;
-    /** reference counter */
-    unsigned int count;
+    /** reference counter. Only updated atomically when the factory
+        is in concurrent mode */
+    std::atomic<unsigned int> count;
+    /** structural hash of the node, computed once at construction */
+    size_t hval;
 
     ExprFactory *fac;
-    std::vector<ENode*> args;
+    ENodeArgs args;
 
-    boost::shared_ptr<Operator> oper;
+    /** the operator. Either interned or owned by the node */
+    const Operator *oper;
     
     
-    void Deref () { if (count > 0) count--; }
+    void Deref ()
+    {
+      unsigned int c = count.load (std::memory_order_relaxed);
+      if (c > 0) count.store (c - 1, std::memory_order_relaxed);
+    }
 
 
     /** assigns a unique id to the node */
@@ -143,11 +227,16 @@ namespace expr
     /** returns the unique id of this expression */
     unsigned int getId () const { return id; }
 
-    void Ref () { count++; }
-    bool isGarbage () const { return count == 0; }
+    /** returns the structural hash of this expression */
+    size_t hash () const { return hval; }
+
+    inline void Ref ();
+    bool isGarbage () const
+    { return count.load (std::memory_order_relaxed) == 0; }
     bool isMutable () const { return oper->isMutable (); }
 
-    unsigned int use_count () { return count; }
+    unsigned int use_count ()
+    { return count.load (std::memory_order_relaxed); }
 
     ENode* operator[] (size_t p) { return arg (p); }
     ENode* arg (size_t p) { return args [p]; }
@@ -163,7 +252,7 @@ namespace expr
     { return args.size () > 0 ? args [args.size () - 1] : NULL; }
     
 
-    typedef std::vector<ENode*>::const_iterator args_iterator;
+    typedef ENodeArgs::const_iterator args_iterator;
 
     bool args_empty () const { return args.empty () ; }
     args_iterator args_begin () const { return args.begin (); }
@@ -200,47 +289,7 @@ namespace expr
 
   struct ENodeUniqueHash
   {
-    std::size_t operator() (const ENode *e) const
-    {
-      size_t res = e->op ().hash ();
-
-      size_t a = e->arity ();
-      if (a == 0) return res;
-
-      ENode::args_iterator it = e->args_begin ();
-      if (a >= 1) 
-	boost::hash_combine (res, *it);
-      
-      if (a >= 2)
-	boost::hash_combine (res, 
-			     boost::hash_range (it, e->args_end ()));
-
-      return res;
-      
-      // if (a == 2) 
-      // 	{
-      // 	  boost::hash_combine (res, *it);
-      // 	  ++it;
-      // 	  boost::hash_combine (res, *it);
-      // 	  return res;
-      // 	}
-      // if (a == 3) 
-      // 	{
-      // 	  boost::hash_combine (res, *it);
-      // 	  it++;
-      // 	  boost::hash_combine (res, *it);
-      // 	  it++;
-      // 	  boost::hash_combine (res, *it);
-      // 	  return res;
-      // 	}
-      
-      // // -- n-arry with more than 3 children
-      // boost::hash_combine (res, 
-      // 			   boost::hash_range (e->args_begin (), 
-      // 					      e->args_end ()));
-      // return res;
-      
-    }
+    std::size_t operator() (const ENode *e) const { return e->hash (); }
   };
     
   struct ENodeUniqueEqual
@@ -262,6 +311,361 @@ namespace expr
   };
     
   
+  /** Hashes the key (op, args) of a would-be node without building
+      it. Children are identified by their unique ids. */
+  template <typename iterator>
+  inline size_t hashENodeKey (const Operator &op, iterator b, iterator e)
+  {
+    size_t res = op.hash ();
+    boost::hash_combine (res, typeid (op).name ());
+    for (; b != e; ++b) boost::hash_combine (res, (*b)->getId ());
+    return res;
+  }
+
+  /** true if node n has operator op and children [b,e) */
+  template <typename iterator>
+  inline bool equalENodeKey (const ENode *n, const Operator &op,
+                             iterator b, iterator e)
+  {
+    return typeid (n->op ()) == typeid (op) &&
+      n->arity () == static_cast<size_t> (std::distance (b, e)) &&
+      n->op () == op &&
+      std::equal (b, e, n->args_begin ());
+  }
+
+  /**
+   * Unique table of an ExprFactory. A single open-addressing table
+   * (linear probing, backward-shift deletion) over all operator
+   * types. Lookups are done by key (operator and children) so that a
+   * node is only allocated when it is not already in the table.
+   */
+  class ENodeUniqueTable : boost::noncopyable
+  {
+    struct Slot
+    {
+      size_t hash;
+      ENode *node;
+      Slot () : hash (0), node (NULL) {}
+    };
+
+    std::vector<Slot> m_slots;
+    size_t m_size;
+
+    size_t mask () const { return m_slots.size () - 1; }
+
+    /** home slot of a hash value */
+    size_t home (size_t h) const
+    {
+      uint64_t x = h;
+      x ^= x >> 33;
+      x *= 0xff51afd7ed558ccdULL;
+      x ^= x >> 33;
+      return static_cast<size_t> (x) & mask ();
+    }
+
+    void grow ()
+    {
+      std::vector<Slot> old;
+      old.swap (m_slots);
+      m_slots.resize (old.size () * 2);
+      for (std::vector<Slot>::const_iterator it = old.begin (),
+             end = old.end (); it != end; ++it)
+        if (it->node)
+        {
+          size_t i = home (it->hash);
+          while (m_slots [i].node) i = (i + 1) & mask ();
+          m_slots [i] = *it;
+        }
+    }
+
+  public:
+    ENodeUniqueTable () : m_slots (1024), m_size (0) {}
+
+    size_t size () const { return m_size; }
+    bool empty () const { return m_size == 0; }
+
+    /** Returns the node with key (op,[b,e)) and hash h or NULL */
+    ENode *find (const Operator &op, ENode *const *b, ENode *const *e,
+                 size_t h) const
+    {
+      for (size_t i = home (h); ; i = (i + 1) & mask ())
+      {
+        const Slot &s = m_slots [i];
+        if (s.node == NULL) return NULL;
+        if (s.hash == h && equalENodeKey (s.node, op, b, e)) return s.node;
+      }
+    }
+
+    /** Inserts n with hash h. n must not already be in the table */
+    void insert (ENode *n, size_t h)
+    {
+      // -- keep the load factor below 0.7
+      if ((m_size + 1) * 10 > m_slots.size () * 7) grow ();
+
+      size_t i = home (h);
+      while (m_slots [i].node) i = (i + 1) & mask ();
+      m_slots [i].hash = h;
+      m_slots [i].node = n;
+      ++m_size;
+    }
+
+    /** Removes n (with hash h) from the table */
+    void erase (ENode *n, size_t h)
+    {
+      size_t i = home (h);
+      while (m_slots [i].node != n)
+      {
+        // -- can only remove things that have been inserted before
+        assert (m_slots [i].node != NULL);
+        i = (i + 1) & mask ();
+      }
+
+      // -- shift back the rest of the cluster to fill the hole at i
+      for (size_t j = (i + 1) & mask (); m_slots [j].node;
+           j = (j + 1) & mask ())
+      {
+        size_t k = home (m_slots [j].hash);
+        // -- k is cyclically in (i,j]: the entry at j cannot move to i
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) continue;
+        m_slots [i] = m_slots [j];
+        i = j;
+      }
+      m_slots [i] = Slot ();
+      --m_size;
+    }
+
+    /** Moves all nodes of the table to out */
+    void extract (std::vector<ENode*> &out)
+    {
+      for (std::vector<Slot>::iterator it = m_slots.begin (),
+             end = m_slots.end (); it != end; ++it)
+        if (it->node)
+        {
+          out.push_back (it->node);
+          *it = Slot ();
+        }
+      m_size = 0;
+    }
+  };
+
+  /**
+   * The original unique table: one hash set per operator type. Kept
+   * for comparison with ENodeUniqueTable (see
+   * UNORDERED_SET_UNIQUE_TABLE).
+   */
+  class ENodeUniqueSetTable : boost::noncopyable
+  {
+    typedef boost::unordered_set<ENode*,
+                                 ENodeUniqueHash,
+                                 ENodeUniqueEqual> entry_type;
+    typedef std::map<const char*,entry_type> table_type;
+    table_type m_table;
+    size_t m_size;
+
+    struct Key
+    {
+      const Operator &op;
+      ENode *const *b;
+      ENode *const *e;
+      Key (const Operator &o, ENode *const *_b, ENode *const *_e) :
+        op (o), b (_b), e (_e) {}
+    };
+
+    struct KeyHash
+    {
+      size_t operator() (const Key &k) const
+      { return hashENodeKey (k.op, k.b, k.e); }
+    };
+
+    struct KeyEqual
+    {
+      bool operator() (const Key &k, ENode *n) const
+      { return equalENodeKey (n, k.op, k.b, k.e); }
+      bool operator() (ENode *n, const Key &k) const
+      { return equalENodeKey (n, k.op, k.b, k.e); }
+    };
+
+  public:
+    ENodeUniqueSetTable () : m_size (0) {}
+
+    size_t size () const { return m_size; }
+    bool empty () const { return m_size == 0; }
+
+    ENode *find (const Operator &op, ENode *const *b, ENode *const *e,
+                 size_t) const
+    {
+      table_type::const_iterator it = m_table.find (typeid (op).name ());
+      if (it == m_table.end ()) return NULL;
+      entry_type::const_iterator x =
+        it->second.find (Key (op, b, e), KeyHash (), KeyEqual ());
+      return x == it->second.end () ? NULL : *x;
+    }
+
+    void insert (ENode *n, size_t)
+    {
+      m_table [typeid (n->op ()).name ()].insert (n);
+      ++m_size;
+    }
+
+    void erase (ENode *n, size_t)
+    {
+      table_type::iterator it = m_table.find (typeid (n->op ()).name ());
+      // -- can only remove things that have been inserted before
+      assert (it != m_table.end ());
+      it->second.erase (n);
+      if (it->second.empty ()) m_table.erase (it);
+      --m_size;
+    }
+
+    void extract (std::vector<ENode*> &out)
+    {
+      for (table_type::const_iterator it = m_table.begin (),
+             end = m_table.end (); it != end; ++it)
+        out.insert (out.end (), it->second.begin (), it->second.end ());
+      m_table.clear ();
+      m_size = 0;
+    }
+  };
+
+  /**
+   * Unique table used by ExprFactory in concurrent mode. The table is
+   * split into shards, each an open-addressing table guarded by its own
+   * lock. Lookups do not take any lock: slots are only ever filled
+   * while the factory is concurrent, and a shard that grows keeps its
+   * old slot array alive until the factory is back to sequential mode.
+   * A lookup that misses is repeated under the lock of the shard
+   * before a node is inserted.
+   */
+  class ENodeConcurrentTable : boost::noncopyable
+  {
+    struct Array
+    {
+      size_t capacity;
+      std::atomic<ENode*> *slots;
+
+      explicit Array (size_t c) :
+        capacity (c), slots (new std::atomic<ENode*> [c])
+      { for (size_t i = 0; i < c; ++i) slots [i].store (NULL); }
+      ~Array () { delete [] slots; }
+    };
+
+    struct Shard
+    {
+      std::mutex lock;
+      std::atomic<Array*> table;
+      size_t size;
+      /** slot arrays replaced by a larger one */
+      std::vector<Array*> retired;
+
+      Shard () : table (new Array (256)), size (0) {}
+      ~Shard ()
+      {
+        delete table.load ();
+        for (size_t i = 0; i < retired.size (); ++i) delete retired [i];
+      }
+    };
+
+    enum { SHARDS = 64 };
+    Shard m_shards [SHARDS];
+
+    static uint64_t mix (size_t h)
+    {
+      uint64_t x = h;
+      x ^= x >> 33;
+      x *= 0xff51afd7ed558ccdULL;
+      x ^= x >> 33;
+      return x;
+    }
+
+    // -- the low bits select the slot, the high bits select the shard
+    static Shard &shard (Shard *shards, size_t h)
+    { return shards [mix (h) >> 58]; }
+    static size_t home (const Array &a, size_t h)
+    { return static_cast<size_t> (mix (h)) & (a.capacity - 1); }
+
+    static ENode *find (const Array &a, const Operator &op,
+                        ENode *const *b, ENode *const *e, size_t h)
+    {
+      for (size_t i = home (a, h); ; i = (i + 1) & (a.capacity - 1))
+      {
+        ENode *n = a.slots [i].load (std::memory_order_acquire);
+        if (n == NULL) return NULL;
+        if (n->hash () == h && equalENodeKey (n, op, b, e)) return n;
+      }
+    }
+
+    static void put (Array &a, ENode *n)
+    {
+      size_t i = home (a, n->hash ());
+      while (a.slots [i].load (std::memory_order_relaxed))
+        i = (i + 1) & (a.capacity - 1);
+      a.slots [i].store (n, std::memory_order_release);
+    }
+
+    static void grow (Shard &s)
+    {
+      Array *old = s.table.load (std::memory_order_relaxed);
+      Array *a = new Array (2 * old->capacity);
+      for (size_t i = 0; i < old->capacity; ++i)
+        if (ENode *n = old->slots [i].load (std::memory_order_relaxed))
+          put (*a, n);
+      s.table.store (a, std::memory_order_release);
+      s.retired.push_back (old);
+    }
+
+  public:
+    /** Returns the node with key (op,[b,e)) and hash h or NULL.
+        Lock-free */
+    ENode *find (const Operator &op, ENode *const *b, ENode *const *e,
+                 size_t h)
+    {
+      Shard &s = shard (m_shards, h);
+      return find (*s.table.load (std::memory_order_acquire), op, b, e, h);
+    }
+
+    /**
+     * Returns the node with key (op,[b,e)) and hash h. If there is
+     * none, inserts the node created by mk (). mk is called under the
+     * lock of the shard.
+     */
+    template <typename Fn>
+    ENode *findOrInsert (const Operator &op, ENode *const *b, ENode *const *e,
+                         size_t h, Fn mk)
+    {
+      Shard &s = shard (m_shards, h);
+      std::lock_guard<std::mutex> lock (s.lock);
+      if (ENode *n = find (*s.table.load (std::memory_order_relaxed),
+                           op, b, e, h))
+        return n;
+
+      Array *a = s.table.load (std::memory_order_relaxed);
+      // -- keep the load factor below 0.7
+      if ((s.size + 1) * 10 > a->capacity * 7) grow (s);
+
+      ENode *n = mk ();
+      put (*s.table.load (std::memory_order_relaxed), n);
+      ++s.size;
+      return n;
+    }
+
+    /** Moves all nodes of the table to out. Not thread-safe */
+    void extract (std::vector<ENode*> &out)
+    {
+      for (size_t k = 0; k < SHARDS; ++k)
+      {
+        Shard &s = m_shards [k];
+        Array *a = s.table.load ();
+        for (size_t i = 0; i < a->capacity; ++i)
+          if (ENode *n = a->slots [i].load (std::memory_order_relaxed))
+          {
+            out.push_back (n);
+            a->slots [i].store (NULL, std::memory_order_relaxed);
+          }
+        s.size = 0;
+      }
+    }
+  };
+
   struct LessENode
   {
     bool operator() (ENode* e1, ENode* e2)
@@ -269,7 +673,7 @@ namespace expr
       if (typeid (e1->op ()) == typeid (e2->op ()))
 	{
 	  if (e1->op () == e2->op ())
-	    return lexicographical_compare (e1->args_begin (), 
+	    return std::lexicographical_compare (e1->args_begin (), 
 					    e1->args_end (),
 					    e2->args_begin (),
 					    e2->args_end ());
@@ -288,8 +692,6 @@ namespace expr
    */
   struct CacheStub 
   {
-    /** true if the stub own the cahce pointer by p */
-    virtual bool owns (const void *p) = 0;
     /** erases val from the underlying cache */
     virtual void erase (ENode *val) = 0;
     virtual ~CacheStub () { }
@@ -303,20 +705,11 @@ namespace expr
     
     CacheStubTmpl (C &c): cache(c) {};
     
-    virtual bool owns (const void *p) { return p == static_cast<const void*> (&cache); }
     virtual void erase (ENode *val) { cache.erase (val); }
   };
   
 
   
-  struct EFADeleter 
-  {
-    ExprFactoryAllocator &m_efa;
-    EFADeleter (ExprFactoryAllocator &efa) : m_efa (efa) {}
-    void operator() (void *p);
-  };
-
-    
   class ExprFactoryAllocator : boost::noncopyable
   {
   private:
@@ -325,13 +718,27 @@ namespace expr
     /** pool for small objects */
     boost::pool<> small;
 
+    /** pools of an arena */
+    struct Arena
+    {
+      boost::pool<> tiny;
+      boost::pool<> small;
+      Arena () : tiny (8, 4096), small (64, 4096) {}
+    };
+    /** open arenas, innermost last */
+    boost::ptr_vector<Arena> arenas;
+
   public:
     ExprFactoryAllocator () : tiny(8, 65536), small (64, 65536) {};
     
     void *allocate (size_t n);
     void free (void *block);
-    
-    EFADeleter get_deleter ();    
+
+    /** Small objects are allocated from a new arena until the
+	matching popArena () */
+    void pushArena () { arenas.push_back (new Arena ()); }
+    /** Releases all memory of the innermost arena at once */
+    void popArena () { arenas.pop_back (); }
   };
   
   
@@ -340,31 +747,65 @@ namespace expr
   {
   protected:
 
-#define UNORDERED_SET_UNIQUE_TABLE 1
+    // -- type of the unique table. Define UNORDERED_SET_UNIQUE_TABLE
+    // -- to get the original table with one hash set per operator type
 #ifndef UNORDERED_SET_UNIQUE_TABLE
-    // -- type of unique table entry
-    typedef std::set<ENode*,LessENode> unique_entry_type;
+    typedef ENodeUniqueTable unique_type;
 #else
-    typedef boost::unordered_set<ENode*, 
-     				 ENodeUniqueHash, 
-				 ENodeUniqueEqual> unique_entry_type;
+    typedef ENodeUniqueSetTable unique_type;
 #endif
-    typedef const char* unique_key_type;
-    // -- type of the unique table
-    typedef std::map<unique_key_type,unique_entry_type> unique_type;
 
-    typedef boost::ptr_vector<CacheStub> caches_type;
+    /** registered caches, by address, so that a cache is registered
+	and unregistered in constant time */
+    typedef boost::unordered_map<const void*,
+				 boost::shared_ptr<CacheStub> > caches_type;
     
 
     /** pool allocator */
     ExprFactoryAllocator allocator;
 
-    /** list of registered caches */
+    /** registered caches */
     caches_type caches;
+    /** guards caches. Threads of a concurrent factory register and
+	unregister caches, e.g., the memo of a SymStore */
+    std::mutex cachesLock;
     
     // -- unique table
     unique_type unique;
 
+    /** true if the factory may be used by several threads */
+    bool concurrent;
+    // -- unique table in concurrent mode
+    boost::scoped_ptr<ENodeConcurrentTable> cunique;
+    /** guards the allocator, the free list and idCount in
+        concurrent mode */
+    std::mutex allocLock;
+    /** mutable nodes that became garbage in concurrent mode */
+    std::vector<ENode*> mutableGarbage;
+
+    /** an open arena: the largest id before it was opened and the
+	position of its first node in arenaNodes */
+    struct ArenaMark
+    {
+      unsigned int id;
+      size_t start;
+    };
+    /** open arenas, innermost last */
+    std::vector<ArenaMark> arenas;
+    /** nodes created in open arenas */
+    std::vector<ENode*> arenaNodes;
+    /** nodes are not reclaimed individually any more */
+    bool bulk;
+
+    /** true if n was created in an open arena */
+    bool inArena (const ENode *n) const
+    { return !arenas.empty () && n->getId () > arenas.front ().id; }
+
+    /** nodes waiting to be removed */
+    std::vector<ENode*> garbage;
+    /** true while Remove () is emptying the garbage worklist */
+    bool draining;
+
     /** counter for assigning unique ids*/
     unsigned int idCount;
     
@@ -372,65 +813,98 @@ namespace expr
     unsigned int uniqueId () { return ++idCount; }
     
     /** 
-     * Remove value from unique table
+     * Remove value from unique table. Children that become garbage are
+     * removed from a worklist rather than recursively, so that deep
+     * expressions do not exhaust the C++ stack.
      */
     void Remove (ENode *val)
     { 
-      clearCaches (val);
-      if (!val->isMutable ())
+      garbage.push_back (val);
+      if (draining) return;
+
+      draining = true;
+      while (!garbage.empty ())
 	{
-	  unique_type::iterator it = unique.find (typeid (val->op ()).name ());
-	  // -- can only remove things that have been inserted before
-	  assert (it != unique.end ());
-	  it->second.erase (val);
-	  if (it->second.empty ()) unique.erase (it);
+	  ENode *n = garbage.back ();
+	  garbage.pop_back ();
+	  clearCaches (n);
+	  if (!n->isMutable ())
+	    unique.erase (n, n->hash ());
+	  // -- pushes children that become garbage onto the worklist
+	  freeNode (n);
 	}
-
-      freeNode (val);
+      draining = false;
     }
 
     /**
-     * Clear val from all registered caches
+     * Clear val from all registered caches. Nodes are only reclaimed
+     * in sequential mode, so caches are not registered concurrently
      */
-    void clearCaches (ENode *val) { forall (CacheStub &c, caches) c.erase (val); }
+    void clearCaches (ENode *val)
+    {
+      forall (caches_type::value_type &c, caches) c.second->erase (val);
+    }
     
     
 
     /**
-     * Return the canonical (unique) representetive of the input
+     * Return the canonical (unique) representetive of the node with
+     * operator op and children [b,e). A new node is only allocated if
+     * there is no such node already.
      */
-    ENode* canonize (ENode* v)
+    ENode* canonize (const Operator &op, ENode *const *b, ENode *const *e)
     {
-      if (v->isMutable ()) 
+      size_t h = hashENodeKey (op, b, e);
+      if (op.isMutable ()) return newNode (op, b, e, h);
+
+      if (concurrent)
 	{
-	  v->setId (uniqueId ());
-	  return v;
+	  // -- lock-free on a hit
+	  ENode *res = cunique->find (op, b, e, h);
+	  if (res) return res;
+	  return cunique->findOrInsert (op, b, e, h,
+					[&] () { return newNode (op, b, e, h); });
 	}
-      
 
-      std::pair<unique_entry_type::iterator,bool> x = 
-	unique [typeid (v->op ()).name ()].insert (v);
-      if (x.second) 
-	{ 
-	  v->setId (uniqueId ());
-	  return v;
+      ENode *res = unique.find (op, b, e, h);
+      if (res) return res;
+
+      res = newNode (op, b, e, h);
+      unique.insert (res, h);
+      return res;
+    }
+
+    /** Allocates a node with operator op, children [b,e) and hash h */
+    ENode* newNode (const Operator &op, ENode *const *b, ENode *const *e,
+		    size_t h)
+    {
+      ENode *res;
+      if (concurrent)
+	{
+	  std::lock_guard<std::mutex> lock (allocLock);
+	  res = allocNode (op);
+	  res->setId (uniqueId ());
 	}
       else
 	{
-	  freeNode (v);
-	  return *x.first;
+	  res = allocNode (op);
+	  res->setId (uniqueId ());
 	}
+
+      for (; b != e; ++b) res->push_back (*b);
+      res->hval = h;
+      if (!arenas.empty ()) arenaNodes.push_back (res);
+      return res;
     }
 
     ENode* mkExpr (const Operator &op)
-    { return canonize (allocNode (op)); }
+    { return canonize (op, NULL, NULL); }
 
     template <typename etype>
     ENode* mkExpr (const Operator &op, etype e)
     {
-      ENode* eVal = allocNode (op);
-      eVal->push_back (eptr (e));
-      return canonize (eVal);
+      ENode *kids [1] = {eptr (e)};
+      return canonize (op, kids, kids + 1);
     }
 
     /** binary */
@@ -439,10 +913,8 @@ namespace expr
 		   etype e1, 
 		   etype e2)
     {
-      ENode* eVal = allocNode (op);
-      eVal->push_back (eptr (e1)); 
-      eVal->push_back (eptr (e2));
-      return canonize (eVal);
+      ENode *kids [2] = {eptr (e1), eptr (e2)};
+      return canonize (op, kids, kids + 2);
     }
 
     /** ternary */
@@ -452,11 +924,8 @@ namespace expr
 		   etype e2,
 		   etype e3)
     {
-      ENode* eVal = allocNode (op);
-      eVal->push_back (eptr (e1)); 
-      eVal->push_back (eptr (e2));
-      eVal->push_back (eptr (e3));
-      return canonize (eVal);
+      ENode *kids [3] = {eptr (e1), eptr (e2), eptr (e3)};
+      return canonize (op, kids, kids + 3);
     }
 
     /* n-ary 
@@ -467,10 +936,9 @@ namespace expr
 		    iterator begin,
 		    iterator end)
     {
-      ENode* eVal = allocNode (op);
-      for (; begin != end; ++begin)
-	eVal->push_back (eptr (*begin));
-      return canonize (eVal);
+      llvm::SmallVector<ENode*, 8> kids;
+      for (; begin != end; ++begin) kids.push_back (eptr (*begin));
+      return canonize (op, kids.begin (), kids.end ());
     }
 
   private:
@@ -480,18 +948,116 @@ namespace expr
     std::vector<ENode*> freeList;
     void freeNode (ENode *n);
     ENode *allocNode (const Operator &op);
+    /** release the operator of n unless it is interned */
+    void freeOp (ENode *n);
 
     
 
 
   public:
-    ExprFactory () : idCount(0) {}
+    ExprFactory () : concurrent(false), bulk(false), draining(false),
+		     idCount(0) {}
+    ~ExprFactory ();
 
     /** Derefernce a value */
     void Deref (ENode* val)
     {
+      if (concurrent)
+	{
+	  // -- garbage stays in the unique table (and can be picked up
+	  // -- again by a lookup) until the factory is sequential again
+	  if (val->count.fetch_sub (1, std::memory_order_relaxed) == 1 &&
+	      val->isMutable ())
+	    {
+	      std::lock_guard<std::mutex> lock (allocLock);
+	      mutableGarbage.push_back (val);
+	    }
+	  return;
+	}
+
+      if (bulk) return;
+
       val->Deref ();
-      if (val->isGarbage ()) Remove (val);
+      // -- garbage of an open arena is released with the arena
+      if (val->isGarbage () && !inArena (val)) Remove (val);
+    }
+
+    bool isConcurrent () const { return concurrent; }
+
+    /**
+     * Opens an arena. Nodes created until the matching popArena () are
+     * not reclaimed one by one. They are all released at once by
+     * popArena (), and must not be referenced after that.
+     */
+    void pushArena ()
+    {
+      assert (!concurrent);
+      ArenaMark m = {idCount, arenaNodes.size ()};
+      arenas.push_back (m);
+      allocator.pushArena ();
+    }
+
+    /** Releases all nodes of the innermost arena */
+    void popArena ();
+
+    /** Opens an arena for the lifetime of the object */
+    class ScopedArena : boost::noncopyable
+    {
+      ExprFactory &m_efac;
+    public:
+      explicit ScopedArena (ExprFactory &efac) : m_efac (efac)
+      { m_efac.pushArena (); }
+      ~ScopedArena () { m_efac.popArena (); }
+    };
+
+    /**
+     * Stops reclaiming nodes. From now on dereferencing does nothing,
+     * and all nodes are released at once by the destructor of the
+     * factory. Used to drop large DAGs quickly at the end of a run.
+     */
+    void bulkRelease () { bulk = true; }
+
+    /**
+     * Switches between the sequential and the concurrent mode. In
+     * concurrent mode, expressions can be created and referenced from
+     * several threads, and nodes that become garbage are only reclaimed
+     * when switching back to sequential mode.
+     *
+     * Must be called when no other thread uses the factory. Caches
+     * can be registered and unregistered in both modes.
+     */
+    void setConcurrent (bool v)
+    {
+      if (v == concurrent) return;
+
+      std::vector<ENode*> nodes;
+      if (v)
+	{
+	  unique.extract (nodes);
+	  cunique.reset (new ENodeConcurrentTable ());
+	  forall (ENode *n, nodes)
+	    cunique->findOrInsert (n->op (), n->args.begin ().base (),
+				   n->args.end ().base (), n->hash (),
+				   [n] () { return n; });
+	  concurrent = true;
+	  return;
+	}
+
+      cunique->extract (nodes);
+      cunique.reset ();
+      concurrent = false;
+
+      std::vector<ENode*> roots;
+      roots.swap (mutableGarbage);
+      forall (ENode *n, nodes)
+	{
+	  unique.insert (n, n->hash ());
+	  if (n->isGarbage ()) roots.push_back (n);
+	}
+
+      // -- a garbage node is not a child of any other node. Removing
+      // -- it only frees nodes that are not garbage yet
+      forall (ENode *n, roots) Remove (n);
     }
 
     /** User functions */
@@ -515,34 +1081,33 @@ namespace expr
     template <typename Cache>
     void registerCache (Cache &cache)
     {
-      // -- to avoid double registration
-      unregisterCache (cache);
-      caches.push_back (static_cast<CacheStub*> (new CacheStubTmpl<Cache> (cache)));
+      std::lock_guard<std::mutex> lock (cachesLock);
+      // -- a second registration replaces the first
+      caches [static_cast<const void*> (&cache)].reset
+	(new CacheStubTmpl<Cache> (cache));
     }
     
     template <typename Cache>
     bool unregisterCache (const Cache &cache)
     {
-      const void *ptr = static_cast<const void*> (&cache);
-      
-      for (caches_type::iterator it = caches.begin (), end = caches.end ();
-	   it != end; ++it)
-	if (it->owns (ptr)) 
-	  {
-	    caches.erase (it);
-	    return true;
-	  }
-      return false;
+      std::lock_guard<std::mutex> lock (cachesLock);
+      return caches.erase (static_cast<const void*> (&cache)) > 0;
     }
     
     friend class ENode;
   };
 
+  inline void ENode::Ref ()
+  {
+    if (fac->isConcurrent ())
+      count.fetch_add (1, std::memory_order_relaxed);
+    else
+      count.store (count.load (std::memory_order_relaxed) + 1,
+		   std::memory_order_relaxed);
+  }
+
   inline ENode::ENode (ExprFactory &f, const Operator &o) :
-    count(0), fac(&f), 
-    oper(o.clone (f.allocator), 
-	 f.allocator.get_deleter (),
-	 boost::pool_allocator<char> ()) {}
+    count(0), hval(0), fac(&f), oper(o.intern (f.allocator)) {}
 }
 
 inline void * operator new (size_t n, expr::ExprFactoryAllocator &alloc)
@@ -555,33 +1120,92 @@ namespace expr
 {
   inline void ExprFactory::freeNode (ENode *n)
   {
-    if (freeList.size () < FREE_LIST_MAX_SIZE) 
-      {      
-	forall (ENode *a, n->args) Deref (a);
-	n->args.clear ();
-	n->oper.reset ();
+    forall (ENode *a, n->args) Deref (a);
+    n->args.clear ();
+    freeOp (n);
+    assert (n->count == 0);
 
-	if (freeList.size () < FREE_LIST_MAX_SIZE) 
-	  { 
-	    assert (n->count == 0);
-	    freeList.push_back (n);
-	    return;
-	  }
+    if (freeList.size () < FREE_LIST_MAX_SIZE) 
+      { 
+	freeList.push_back (n);
+	return;
       }
 
+    n->~ENode ();
     operator delete (static_cast<void*>(n), allocator);
   }
 
+  inline void ExprFactory::freeOp (ENode *n)
+  {
+    if (!n->oper->isStateless ())
+      {
+	Operator *op = const_cast<Operator*> (n->oper);
+	op->~Operator ();
+	operator delete (static_cast<void*> (op), allocator);
+      }
+    n->oper = NULL;
+  }
+
+  inline void ExprFactory::popArena ()
+  {
+    assert (!arenas.empty ());
+    ArenaMark m = arenas.back ();
+    arenas.pop_back ();
+
+    // -- first make sure that no node of the arena can be found, then
+    // -- release them without following the children
+    for (size_t i = m.start, sz = arenaNodes.size (); i < sz; ++i)
+      {
+	ENode *n = arenaNodes [i];
+	clearCaches (n);
+	if (!n->isMutable ()) unique.erase (n, n->hash ());
+      }
+
+    for (size_t i = m.start, sz = arenaNodes.size (); i < sz; ++i)
+      {
+	ENode *n = arenaNodes [i];
+	// -- children from outside of the arena are dereferenced as usual
+	forall (ENode *a, n->args)
+	  if (a->getId () <= m.id) Deref (a);
+	n->args.clear ();
+	freeOp (n);
+	n->~ENode ();
+	operator delete (static_cast<void*> (n), allocator);
+      }
+    arenaNodes.resize (m.start);
+    allocator.popArena ();
+  }
+
+  inline ExprFactory::~ExprFactory ()
+  {
+    bulk = true;
+    if (concurrent) setConcurrent (false);
+
+    // -- release the operators and child buffers of the remaining
+    // -- nodes. Their memory goes away with the allocator
+    std::vector<ENode*> nodes;
+    unique.extract (nodes);
+    forall (ENode *n, arenaNodes)
+      if (n->isMutable ()) nodes.push_back (n);
+    forall (ENode *n, nodes)
+      {
+	// -- only run the destructors, memory of the pools is freed at once
+	if (!n->oper->isStateless ())
+	  const_cast<Operator*> (n->oper)->~Operator ();
+	n->~ENode ();
+      }
+    forall (ENode *n, freeList) n->~ENode ();
+  }
+
   inline ENode *ExprFactory::allocNode (const Operator &op)
   {
-    if (freeList.empty ())
+    // -- nodes of an arena are allocated from its pools
+    if (freeList.empty () || !arenas.empty ())
       return new(allocator) ENode (*this, op);
       
     ENode *res = freeList.back ();
     freeList.pop_back ();
-    res->oper.reset (op.clone (allocator), 
-		     allocator.get_deleter (),
-		     boost::pool_allocator<char> ());
+    res->oper = op.intern (allocator);
     assert (res->count == 0);
     return res;
   }
@@ -589,6 +1213,13 @@ namespace expr
 
   inline void *ExprFactoryAllocator::allocate (size_t n)
   { 
+    if (!arenas.empty ())
+      {
+	Arena &a = arenas.back ();
+	if (n <= a.tiny.get_requested_size ()) return a.tiny.malloc ();
+	else if (n <= a.small.get_requested_size ()) return a.small.malloc ();
+      }
+
     if (n <= tiny.get_requested_size ()) return tiny.malloc ();
     else if (n <= small.get_requested_size ()) return small.malloc ();
     
@@ -598,16 +1229,18 @@ namespace expr
 
   inline void ExprFactoryAllocator::free (void *block) 
   { 
+    for (boost::ptr_vector<Arena>::reverse_iterator it = arenas.rbegin (),
+	   end = arenas.rend (); it != end; ++it)
+      {
+	if (it->tiny.is_from (block)) { it->tiny.free (block); return; }
+	if (it->small.is_from (block)) { it->small.free (block); return; }
+      }
+
     if (tiny.is_from (block)) tiny.free (block);
     else if (small.is_from (block)) small.free (block);
     else delete [] static_cast<char * const> (block); 
   }  
 
-  inline EFADeleter ExprFactoryAllocator::get_deleter () 
-  { return EFADeleter (*this); }
-
-  inline void EFADeleter::operator() (void *p)
-  { operator delete (p, m_efa); }
 
   template <typename T>
   struct TerminalTrait {};
@@ -632,7 +1265,7 @@ namespace expr
     
 
     void Print (std::ostream &OS, 
-		const std::vector<ENode*> &args,
+		const ENodeArgs &args,
 		int depth = 0, 
 		bool brkt = true) const
     {
@@ -737,12 +1370,17 @@ namespace expr
     static inline bool equal_to (const mpz_class &v1, const mpz_class &v2)
     { return v1 == v2; }
     
-    static inline size_t hash (const mpz_class &v)
+    /** hashes the limbs of v directly */
+    static inline size_t hash (mpz_srcptr v)
     {
-      std::string str = boost::lexical_cast<std::string> (v);
-      boost::hash<std::string> hasher;
-      return hasher (str);
+      size_t res = mpz_sgn (v);
+      for (size_t i = 0, sz = mpz_size (v); i < sz; ++i)
+	boost::hash_combine (res, mpz_getlimbn (v, i));
+      return res;
     }
+
+    static inline size_t hash (const mpz_class &v)
+    { return hash (v.get_mpz_t ()); }
     
     
 
@@ -765,10 +1403,12 @@ namespace expr
     
     static inline size_t hash (const mpq_class &v)
     {
-      std::string str = boost::lexical_cast<std::string> (v);
-      boost::hash<std::string> hasher;
-      return hasher (str);
-    }    
+      size_t res = TerminalTrait<mpz_class>::hash (mpq_numref (v.get_mpq_t ()));
+      boost::hash_combine (res,
+			   TerminalTrait<mpz_class>::hash
+			   (mpq_denref (v.get_mpq_t ())));
+      return res;
+    }
   };
 
 
@@ -796,7 +1436,7 @@ namespace expr
 				int depth,
 				bool brkt,
 				const std::string &name,
-				const std::vector<ENode*> &args)	
+				const ENodeArgs &args)	
       {
 	if (args.size () >= 2) OS << "[";
 	if (args.size () == 1 && brkt) OS << "(";
@@ -813,7 +1453,7 @@ namespace expr
 	  }
 	  
 
-	for (std::vector<ENode*>::const_iterator it = args.begin (), 
+	for (ENodeArgs::const_iterator it = args.begin (), 
 	       end = args.end (); it != end; ++it)
 	  {
 	    OS << "\n";
@@ -834,7 +1474,7 @@ namespace expr
 				int depth,
 				bool brkt,
 				const std::string &name,
-				const std::vector<ENode*> &args)	
+				const ENodeArgs &args)	
       {
 	
 	if (args.size () != 2) 
@@ -859,13 +1499,13 @@ namespace expr
 				int depth,
 				bool brkt,
 				const std::string &name,
-				const std::vector<ENode*> &args)	
+				const ENodeArgs &args)	
       {
 	OS << name << "(";
       
 	
 	bool first = true;
-	for (std::vector<ENode*>::const_iterator it = args.begin (), 
+	for (ENodeArgs::const_iterator it = args.begin (), 
 	       end = args.end (); it != end; ++it)
 	  {
 	    if (!first) OS << ", ";
@@ -883,12 +1523,12 @@ namespace expr
 				int depth,
 				bool brkt,
 				const std::string &name,
-				const std::vector<ENode*> &args)	
+				const ENodeArgs &args)	
       {
 	OS << "(" << name << " ";
       
 	bool first = true;
-	for (std::vector<ENode*>::const_iterator it = args.begin (), 
+	for (ENodeArgs::const_iterator it = args.begin (), 
 	       end = args.end (); it != end; ++it)
 	  {
 	    if (!first) OS << " ";
@@ -949,7 +1589,7 @@ namespace expr
     typedef P ps_type;
     
     void Print (std::ostream &OS, 
-		const std::vector<ENode*> &args,
+		const ENodeArgs &args,
 		int depth = 0, 
 		bool brkt = true) const
     { ps_type::print (OS, depth, brkt, op_type::name (), args);  }
@@ -965,6 +1605,18 @@ namespace expr
     
     this_type * clone (ExprFactoryAllocator &allocator) const 
     { return new (allocator) this_type (*this); }
+
+    bool isStateless () const { return true; }
+
+    /** the shared instance of the operator */
+    static const this_type &instance ()
+    {
+      static const this_type op = this_type ();
+      return op;
+    }
+
+    const Operator* intern (ExprFactoryAllocator &allocator) const
+    { return &instance (); }
       
   };
 
@@ -980,16 +1632,18 @@ namespace expr
   template <typename iterator>
   void ENode::renew_args (iterator b, iterator e)
   {
-    std::vector<ENode*> old = args;
-    args = std::vector<ENode*> ();
+    llvm::SmallVector<ENode*, ENodeArgs::INLINE> old (args.begin (),
+                                                      args.end ());
+    args.clear ();
     
     // -- increment reference count of all new arguments
     for (; b != e; ++b)
       this->push_back (eptr (*b));
     
+    hval = hashENodeKey (*oper, args.begin (), args.end ());
+
     // -- decrement reference count of all old arguments
-    for (args_iterator b = old.begin (), e = old.end ();
-	 b != e; ++b)
+    for (ENode **b = old.begin (), **e = old.end (); b != e; ++b)
       efac().Deref (*b);
   }
 
@@ -1028,139 +1682,272 @@ namespace expr
     Expr operator() (Expr e) { return e; }
   };
 
-  struct ExprFn
-  {
-    virtual ~ExprFn () {}
-    virtual Expr apply (Expr e) = 0;
-  };
-
-  namespace
-  {
-    template <typename T>
-    struct ExprFunctionoid : public ExprFn
-    {
-      typedef boost::shared_ptr<T> fn_type;
-
-      fn_type fn;
-
-      ExprFunctionoid (T* f) : fn_type (fn) {}
-      ExprFunctionoid (fn_type f) : fn(f) {}
-      Expr apply (Expr e) { return (*fn)(e); }
-    };
-      
-  }
-  
-
   class VisitAction
   {
   public:
 
     // skipKids or doKids
     VisitAction (bool kids = false) : 
-      _skipKids (kids), fn (new ExprFunctionoid<IdentityRewriter> 
-			   (boost::shared_ptr<IdentityRewriter> 
-			    (new IdentityRewriter ()))) {};
+      _skipKids (kids), rw (NULL), fn (NULL) {};
     
-    // changeTo or doKidsRewrite
+    // changeTo or changeDoKids
+    VisitAction (Expr e, bool kids = false) :
+      _skipKids (kids), expr (e), rw (NULL), fn (NULL) {}
+
+    /** doKidsRewrite. The rewriter is not copied and must outlive
+	the action. Usually it is owned by the visitor */
+    template <typename R>
+    VisitAction (Expr e, bool kids, R &r) :
+      _skipKids(kids), expr(e), rw (&r), fn (&applyRewriter<R>) {}
+
+    /** doKidsRewrite. The action shares the ownership of the rewriter */
     template <typename R>
-    VisitAction (Expr e, bool kids = false, 
-		 boost::shared_ptr<R> r = 
-		 boost::shared_ptr<IdentityRewriter> 
-		 (new IdentityRewriter ())) :
-      _skipKids(kids), expr(e), fn(new ExprFunctionoid<R> (r)) {}
+    VisitAction (Expr e, bool kids, boost::shared_ptr<R> r) :
+      _skipKids(kids), expr(e), rw (r.get ()), fn (&applyRewriter<R>),
+      owner (r) {}
     
     bool isSkipKids () { return _skipKids && expr.get () == NULL; }
     bool isChangeTo () { return _skipKids && expr.get () != NULL; }
     bool isDoKids () { return !_skipKids && expr.get () == NULL; }
     bool isChangeDoKidsRewrite () { return !_skipKids && expr.get () != NULL; }
 
-    Expr rewrite (Expr v) { return fn->apply (v); }
+    Expr rewrite (Expr v) { return fn ? fn (rw, v) : v; }
 
     Expr getExpr () { return expr; }
 
     static inline VisitAction skipKids () { return VisitAction (true); }
     static inline VisitAction doKids () { return VisitAction (false); }
     static inline VisitAction changeTo (Expr e) 
-    { return VisitAction (e, true, 
-			  boost::shared_ptr<IdentityRewriter> 
-			  (new IdentityRewriter())); 
-    }
+    { return VisitAction (e, true); }
     static inline VisitAction changeDoKids (Expr e) 
-    { return VisitAction (e, false, 
-			  boost::shared_ptr<IdentityRewriter> 
-			  (new IdentityRewriter())); 
-    }
+    { return VisitAction (e, false); }
     template <typename R> 
     static inline VisitAction changeDoKidsRewrite 
     (Expr e, boost::shared_ptr<R> r) 
     { return VisitAction (e, false, r); }
+    template <typename R> 
+    static inline VisitAction changeDoKidsRewrite (Expr e, R &r) 
+    { return VisitAction (e, false, r); }
 
   protected:
     bool _skipKids;
     Expr expr;
   private:
-    boost::shared_ptr<ExprFn> fn;
+    template <typename R>
+    static Expr applyRewriter (void *r, Expr e) 
+    { return (*static_cast<R*> (r)) (e); }
+
+    /** the rewriter, or NULL for the identity */
+    void *rw;
+    Expr (*fn) (void*, Expr);
+    /** keeps a shared rewriter alive, NULL for a borrowed one */
+    boost::shared_ptr<void> owner;
   };
 
 
   typedef boost::unordered_map<ENode*,Expr> DagVisitCache;
 
-  template <typename ExprVisitor> 
-  Expr visit (ExprVisitor &v, Expr expr, DagVisitCache &cache)
+  /**
+   * Memo table of a visitor that is kept across many visits. By
+   * default keys are not referenced. The memo is a registered cache
+   * of the factory, which drops the entry of a key when the key is
+   * reclaimed. Results are referenced, so clear () releases them,
+   * except for a result that is its own key: it would keep the key
+   * alive and the entry would never be dropped.
+   *
+   * A memo that holds its keys is not registered. It costs nothing
+   * when the factory reclaims nodes, but keeps its keys alive until
+   * clear (). Suited to many short-lived memos.
+   *
+   * Only valid for visitors whose result for a node does not change
+   * between visits (or that clear () the memo when it does).
+   */
+  class DagVisitMemo : boost::noncopyable
   {
-    if (expr->use_count () > 1)
-      {
-	DagVisitCache::const_iterator cit 
-	  = cache.find (&*expr);
-	if (cit != cache.end ()) return cit->second;
-      }
+    typedef boost::unordered_map<ENode*,Expr> map_type;
     
+    ExprFactory &m_efac;
+    map_type m_map;
+    /** keys of m_map if the memo holds its keys */
+    ExprVector m_keys;
+    bool m_holdKeys;
     
-    VisitAction va = v(expr);
-    Expr res;
+  public:
+    explicit DagVisitMemo (ExprFactory &efac, bool holdKeys = false) :
+      m_efac (efac), m_holdKeys (holdKeys)
+    { if (!m_holdKeys) m_efac.registerCache (*this); }
+    ~DagVisitMemo () { if (!m_holdKeys) m_efac.unregisterCache (*this); }
 
-    if (va.isSkipKids ())
-      res = expr;
-    else if (va.isChangeTo ())
-      res = va.getExpr ();
-    else
-      {
-	res = va.isChangeDoKidsRewrite () ? va.getExpr () : expr;
-	if (res->arity () > 0) 
-	  {
-	    bool changed = false;
-            std::vector<Expr> kids;
+    bool lookup (ENode *e, Expr &res) const
+    {
+      map_type::const_iterator it = m_map.find (e);
+      if (it == m_map.end ()) return false;
+      // -- a NULL entry stands for the key itself
+      res = it->second ? it->second : Expr (e);
+      return true;
+    }
+    
+    void insert (ENode *e, const Expr &res)
+    {
+      std::pair<map_type::iterator, bool> r =
+	m_map.insert (std::make_pair (e, Expr ()));
+      if (r.second && m_holdKeys) m_keys.push_back (Expr (e));
+      r.first->second = res.get () == e ? Expr () : res;
+    }
+    bool count (ENode *e) const { return m_map.count (e) > 0; }
+    size_t size () const { return m_map.size (); }
+    
+    /** called by the factory when e is reclaimed */
+    void erase (ENode *e) { m_map.erase (e); }
+    
+    void clear ()
+    {
+      // -- releasing the results may reclaim keys, which calls
+      // -- erase () while the map is being cleared
+      map_type old;
+      old.swap (m_map);
+      ExprVector keys;
+      keys.swap (m_keys);
+    }
+  };
+  
+  namespace detail
+  {
+    /** cache of a visit that does not remember results */
+    struct NoVisitCache {};
+    
+    inline bool lookupVisit (NoVisitCache &, ENode *, Expr &) { return false; }
+    inline void cacheVisit (NoVisitCache &, ENode *, const Expr &) {}
 
-	    for (ENode::args_iterator b = res->args_begin (), 
-		   e = res->args_end (); 
-		 b != e; ++b)
-	      {
-		Expr k = visit (v, *b, cache);
-		kids.push_back (k);
-		changed  = (changed || k.get () != *b);
-	      }
-	    
-	    if (changed)
-	      {
-		if (!res->isMutable ())
-		  res = res->getFactory ().mkNary (res->op (),
-						   kids.begin (),
-						   kids.end ());
-		else
-		  res->renew_args (kids.begin (), kids.end ());
-	      }
-	  }
+    /** only nodes with more than one reference can be seen twice */
+    inline bool lookupVisit (DagVisitCache &cache, ENode *e, Expr &res)
+    {
+      if (e->use_count () <= 1) return false;
+      DagVisitCache::const_iterator cit = cache.find (e);
+      if (cit == cache.end ()) return false;
+      res = cit->second;
+      return true;
+    }
     
-	res = va.rewrite (res);
-      }
+    inline void cacheVisit (DagVisitCache &cache, ENode *e, const Expr &res)
+    {
+      if (e->use_count () > 1)
+	{
+	  e->Ref ();
+	  cache[e] = res;
+	}
+    }
+
+    /** every node is looked up and remembered */
+    inline bool lookupVisit (DagVisitMemo &memo, ENode *e, Expr &res)
+    { return memo.lookup (e, res); }
+    inline void cacheVisit (DagVisitMemo &memo, ENode *e, const Expr &res)
+    { memo.insert (e, res); }
 
-    if (expr->use_count () > 1)
+    /**
+     * Post-order visit of expr with an explicit stack. The result of
+     * each node is looked up and remembered in cache.
+     */
+    template <typename ExprVisitor, typename Cache>
+    Expr visit (ExprVisitor &v, Expr expr, Cache &cache)
+    {
+      // -- a node whose children are being visited
+      struct Frame
       {
-	expr->Ref ();
-	cache[&*expr] = res;
-      }
-    
-    return res;
+	Expr expr;
+	VisitAction va;
+	/** node whose children are visited */
+	Expr res;
+	/** next child to visit */
+	ENode::args_iterator next;
+	/** position of the result of the first child in kids */
+	size_t kids;
+	bool changed;
+	
+	Frame (Expr e, const VisitAction &a, Expr r, size_t k) :
+	  expr (e), va (a), res (r), next (r->args_begin ()), 
+	  kids (k), changed (false) {}
+      };
+      
+      std::vector<Frame> stack;
+      // -- results of the visited children of the nodes on the stack
+      std::vector<Expr> kids;
+      // -- result of the last completed node
+      Expr res;
+      
+      for (;;)
+	{
+	  // -- enter expr
+	  bool done = true;
+	  if (!lookupVisit (cache, &*expr, res))
+	    {
+	      VisitAction va = v (expr);
+	      if (va.isSkipKids ())
+		res = expr;
+	      else if (va.isChangeTo ())
+		res = va.getExpr ();
+	      else
+		{
+		  Expr r = va.isChangeDoKidsRewrite () ? va.getExpr () : expr;
+		  stack.push_back (Frame (expr, va, r, kids.size ()));
+		  // -- the frame holds the only reference of the visit
+		  expr.reset ();
+		  done = false;
+		}
+	      if (done) cacheVisit (cache, &*expr, res);
+	    }
+	  
+	  // -- leave completed nodes until one has a child left to visit
+	  for (;;)
+	    {
+	      if (stack.empty ()) return res;
+	      
+	      Frame &f = stack.back ();
+	      if (done)
+		{
+		  f.changed = f.changed || res.get () != *f.next;
+		  kids.push_back (res);
+		  ++f.next;
+		}
+	      
+	      if (f.next != f.res->args_end ())
+		{
+		  expr = *f.next;
+		  break;
+		}
+	      
+	      res = f.res;
+	      if (f.changed)
+		{
+		  if (!res->isMutable ())
+		    res = res->getFactory ().mkNary (res->op (),
+						     kids.begin () + f.kids,
+						     kids.end ());
+		  else
+		    res->renew_args (kids.begin () + f.kids, kids.end ());
+		}
+	      kids.resize (f.kids);
+	      
+	      res = f.va.rewrite (res);
+	      cacheVisit (cache, &*f.expr, res);
+	      stack.pop_back ();
+	      done = true;
+	    }
+	}
+    }
+  }
+
+  template <typename ExprVisitor> 
+  Expr visit (ExprVisitor &v, Expr expr, DagVisitCache &cache)
+  {
+    return detail::visit (v, expr, cache);
+  }  
+
+  /** visit with a memo that is kept across visits */
+  template <typename ExprVisitor> 
+  Expr visit (ExprVisitor &v, Expr expr, DagVisitMemo &memo)
+  {
+    return detail::visit (v, expr, memo);
   }  
 
   inline void clearDagVisitCache (DagVisitCache &cache)
@@ -1191,47 +1978,27 @@ namespace expr
     Expr operator() (Expr e)  { return visit (m_v, e, m_cache); }
     
   };
-  
-    
 
+  /** Like DagVisit, but keeps results in a DagVisitMemo */
   template <typename ExprVisitor>
-  Expr visit (ExprVisitor &v, Expr expr)
+  struct MemoDagVisit : public std::unary_function<Expr,Expr>
   {
-    VisitAction va = v (expr);
-    
-    if (va.isSkipKids ()) return expr;
-
-    if (va.isChangeTo ()) return va.getExpr ();
+    ExprVisitor &m_v;
+    DagVisitMemo m_memo;
     
-    Expr res = va.isChangeDoKidsRewrite () ? va.getExpr () : expr;
+    MemoDagVisit (ExprVisitor &v, ExprFactory &efac) : m_v (v), m_memo (efac) {}
     
-    if (res->arity () == 0) return va.rewrite (res);
-
-    bool changed = false;
-    std::vector<Expr> kids;
-
-    for (ENode::args_iterator b = res->args_begin (), 
-	   e = res->args_end (); 
-	 b != e; ++b)
-      {
-	Expr k = visit (v, *b);
-	kids.push_back (k);
-	changed  = (changed || k.get () != *b);
-      }
-
-    if (changed)
-      {
-	if (!res->isMutable ())
-	  res = res->getFactory ().mkNary (res->op (),
-					   kids.begin (),
-					   kids.end ());
-	else
-	  res->renew_args (kids.begin (), kids.end ());
-      }
+    Expr operator() (Expr e)  { return visit (m_v, e, m_memo); }
+    void clear () { m_memo.clear (); }
+  };
+  
     
-    res = va.rewrite (res);
 
-    return res;
+  template <typename ExprVisitor>
+  Expr visit (ExprVisitor &v, Expr expr)
+  {
+    detail::NoVisitCache cache;
+    return detail::visit (v, expr, cache);
   }
 
   /**********************************************************************/
@@ -1563,7 +2330,7 @@ namespace expr
 		}
 	      
 	      // -- arity > 2, check if one arguments is true
-	      forall (ENode *arg, make_pair (exp->args_begin (), 
+	      forall (ENode *arg, std::make_pair (exp->args_begin (), 
 					      exp->args_end ()))
 		if (trueE == arg) return trueE;
 	      return exp;
@@ -1590,7 +2357,7 @@ namespace expr
 		}
 
 	      // -- arity > 2, check if one arguments  is false
-	      forall (ENode * arg, make_pair (exp->args_begin (), 
+	      forall (ENode * arg, std::make_pair (exp->args_begin (), 
 					       exp->args_end ()))
 		if (falseE == arg) return falseE;
 	      return exp;
@@ -1641,14 +2408,14 @@ namespace expr
 	    }
 	  
 	  ExprSet newArgs;
-	  forall (Expr a, make_pair (exp->args_begin (), exp->args_end ()))
+	  forall (Expr a, std::make_pair (exp->args_begin (), exp->args_end ()))
 	    if (! (op == a->op ()) )
 	      {
 		if (a == bot) return bot;
 		else if (a != top) newArgs.insert (a);
 	      }
 	    else /* descend into kids that have the same top-level operator */
-	      forall (Expr ka, make_pair (a->args_begin (), a->args_end ()))
+	      forall (Expr ka, std::make_pair (a->args_begin (), a->args_end ()))
 		if (ka == bot) return bot;
 		else if (ka != top) newArgs.insert (ka);
 
@@ -1704,14 +2471,14 @@ namespace expr
 	    }
 
 	  ExprSet newArgs;
-	  forall (Expr a, make_pair (exp->args_begin (), exp->args_end ()))
+	  forall (Expr a, std::make_pair (exp->args_begin (), exp->args_end ()))
 	    if (! (op == a->op ()) )
 	      {
 		if (a == bot) return bot;
 		else if (a != top) newArgs.insert (a);
 	      }
 	    else /* descend into kids that have the same top-level operator */
-	      forall (Expr ka, make_pair (a->args_begin (), a->args_end ()))
+	      forall (Expr ka, std::make_pair (a->args_begin (), a->args_end ()))
 		if (ka == bot) return bot;
 		else if (ka != top) newArgs.insert (ka);
 
@@ -1839,7 +2606,7 @@ namespace expr
 	    {
 	      // -- negate arguments
 	      ExprVector args;
-	      forall (Expr arg, make_pair (lhs->args_begin (), 
+	      forall (Expr arg, std::make_pair (lhs->args_begin (), 
 					    lhs->args_end ()))
 		args.push_back (lneg (arg));
 
@@ -1935,7 +2702,7 @@ namespace expr
 				  int depth,
 				  bool brkt,
 				  const std::string &name,
-				  const std::vector<ENode*> &args)	
+				  const ENodeArgs &args)	
 	{
 	  OS << "[";
 	  args [0]->Print (OS, depth, false);
@@ -1985,7 +2752,7 @@ namespace expr
 				  int depth,
 				  bool brkt,
 				  const std::string &name,
-				  const std::vector<ENode*> &args)
+				  const ENodeArgs &args)
 	{
 	  args [1]->Print (OS, depth, true);
 	  OS << "_";
@@ -2087,7 +2854,7 @@ namespace expr
 				  int depth,
 				  bool brkt,
 				  const std::string &name,
-				  const std::vector<ENode*> &args)	
+				  const ENodeArgs &args)	
 	{
 	  OS << "[" << name << " ";
 	  args[0]->Print (OS, depth+2, false);
@@ -2269,7 +3036,7 @@ namespace expr
 				  int depth, 
 				  int brkt,
 				  const std::string &name,
-				  const std::vector<ENode*> &args)
+				  const ENodeArgs &args)
 	{
 	  if (args.size () > 1) OS << "(";
 
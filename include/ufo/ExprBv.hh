@@ -66,7 +66,7 @@ namespace expr
       {return mkTerm<const BvSort> (BvSort (width), efac);}
       
       inline unsigned width (Expr bvsort)
-      {return getTerm<const BvSort*>(bvsort)->m_width;}
+      {return getTerm<const BvSort> (bvsort).m_width;}
       
       /// Bit-vector numeral of a given sort
       /// num is an integer numeral, and bvsort is a bit-vector sort
@@ -133,6 +133,26 @@ namespace expr
       /* XXX Add helper methods as needed */
 
       inline Expr bvnot (Expr v) {return mk<BNOT> (v);}
+
+      /// bit-vector constant of a given name and width
+      inline Expr bvConst (Expr name, unsigned width)
+      {return bind::mkConst (name, bvsort (width, name->efac ()));}
+
+      /// bits hi..lo (inclusive) of v
+      inline Expr extract (unsigned hi, unsigned lo, Expr v)
+      {
+        assert (hi >= lo);
+        return mk<BEXTRACT> (mkTerm (mpz_class (hi), v->efac ()),
+                             mkTerm (mpz_class (lo), v->efac ()), v);
+      }
+
+      /// sign-extension of v to width bits
+      inline Expr sext (Expr v, unsigned width)
+      {return mk<BSEXT> (v, bvsort (width, v->efac ()));}
+
+      /// zero-extension of v to width bits
+      inline Expr zext (Expr v, unsigned width)
+      {return mk<BZEXT> (v, bvsort (width, v->efac ()));}
       
     }
     
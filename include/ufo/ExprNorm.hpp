@@ -0,0 +1,324 @@
+#ifndef __EXPR__NORM__HPP_
+#define __EXPR__NORM__HPP_
+
+/** Normalizing constructors.
+
+ * Drop-in replacements for mk<T> and mknary<T> that return a normal
+ * form instead of the expression they are given:
+
+ *  - AND, OR, PLUS and MULT are flattened, neutral elements are
+ *    dropped, absorbing elements are propagated, and the arguments are
+ *    ordered by node id (AND and OR also drop duplicates);
+ *  - MPZ numerals are folded in arithmetic and comparisons;
+ *  - NEG and IMPL apply the simplifications of boolop.
+
+ * Normalization is opt-in: mk<T> still builds exactly what it is given.
+ */
+
+#include "ufo/Expr.hpp"
+
+#include <algorithm>
+
+namespace expr
+{
+  namespace op
+  {
+    namespace norm
+    {
+      namespace detail
+      {
+	inline bool idLess (const Expr &a, const Expr &b)
+	{ return a->getId () < b->getId (); }
+
+	inline bool isNum (const Expr &e) { return isOpX<MPZ> (e); }
+	inline mpz_class num (const Expr &e)
+	{ return getTerm<mpz_class> (e); }
+	inline Expr mkNum (const mpz_class &v, ExprFactory &efac)
+	{ return mkTerm<mpz_class> (v, efac); }
+
+	/** replaces nested applications of T in args by their
+	    arguments. Uses an explicit stack since nested chains can be
+	    deep */
+	template <typename T>
+	void flatten (ExprVector &args)
+	{
+	  bool nested = false;
+	  forall (const Expr &a, args)
+	    if (isOpX<T> (a)) { nested = true; break; }
+	  if (!nested) return;
+
+	  ExprVector res;
+	  ExprVector todo (args.rbegin (), args.rend ());
+	  while (!todo.empty ())
+	    {
+	      Expr e = todo.back ();
+	      todo.pop_back ();
+	      if (isOpX<T> (e))
+		for (ENode::args_iterator b = e->args_end (),
+		       end = e->args_begin (); b != end; )
+		  todo.push_back (*--b);
+	      else
+		res.push_back (e);
+	    }
+	  args.swap (res);
+	}
+
+	/** sorts args by id and drops duplicates */
+	inline void sortUnique (ExprVector &args)
+	{
+	  std::sort (args.begin (), args.end (), idLess);
+	  args.erase (std::unique (args.begin (), args.end ()), args.end ());
+	}
+
+	/** true if args (sorted by id) contain some x and !x */
+	inline bool complementary (const ExprVector &args)
+	{
+	  forall (const Expr &a, args)
+	    if (isOpX<NEG> (a) &&
+		std::binary_search (args.begin (), args.end (),
+				    a->left (), idLess))
+	      return true;
+	  return false;
+	}
+
+	/** mpz comparison with the semantics of T */
+	template <typename T> struct Cmp;
+	template <> struct Cmp<EQ>
+	{ static bool apply (int c) { return c == 0; } };
+	template <> struct Cmp<NEQ>
+	{ static bool apply (int c) { return c != 0; } };
+	template <> struct Cmp<LT>
+	{ static bool apply (int c) { return c < 0; } };
+	template <> struct Cmp<LEQ>
+	{ static bool apply (int c) { return c <= 0; } };
+	template <> struct Cmp<GT>
+	{ static bool apply (int c) { return c > 0; } };
+	template <> struct Cmp<GEQ>
+	{ static bool apply (int c) { return c >= 0; } };
+      }
+
+      /**
+       * Builds the normal form of T applied to args. args is used as
+       * scratch space. The default is no normalization.
+       */
+      template <typename T>
+      struct Normalizer
+      {
+	static Expr apply (ExprFactory &efac, ExprVector &args)
+	{ return efac.mkNary (T (), args); }
+      };
+
+      template <> struct Normalizer<AND>
+      {
+	static Expr apply (ExprFactory &efac, ExprVector &args)
+	{
+	  detail::flatten<AND> (args);
+
+	  ExprVector res;
+	  forall (const Expr &a, args)
+	    {
+	      if (isOpX<FALSE> (a)) return a;
+	      if (!isOpX<TRUE> (a)) res.push_back (a);
+	    }
+
+	  detail::sortUnique (res);
+	  if (res.empty ()) return expr::mk<TRUE> (efac);
+	  if (res.size () == 1) return res [0];
+	  if (detail::complementary (res)) return expr::mk<FALSE> (efac);
+	  return efac.mkNary (AND (), res);
+	}
+      };
+
+      template <> struct Normalizer<OR>
+      {
+	static Expr apply (ExprFactory &efac, ExprVector &args)
+	{
+	  detail::flatten<OR> (args);
+
+	  ExprVector res;
+	  forall (const Expr &a, args)
+	    {
+	      if (isOpX<TRUE> (a)) return a;
+	      if (!isOpX<FALSE> (a)) res.push_back (a);
+	    }
+
+	  detail::sortUnique (res);
+	  if (res.empty ()) return expr::mk<FALSE> (efac);
+	  if (res.size () == 1) return res [0];
+	  if (detail::complementary (res)) return expr::mk<TRUE> (efac);
+	  return efac.mkNary (OR (), res);
+	}
+      };
+
+      template <> struct Normalizer<PLUS>
+      {
+	static Expr apply (ExprFactory &efac, ExprVector &args)
+	{
+	  detail::flatten<PLUS> (args);
+
+	  mpz_class sum = 0;
+	  ExprVector res;
+	  forall (const Expr &a, args)
+	    {
+	      if (detail::isNum (a)) sum += detail::num (a);
+	      else res.push_back (a);
+	    }
+
+	  if (res.empty ()) return detail::mkNum (sum, efac);
+	  if (sum != 0) res.push_back (detail::mkNum (sum, efac));
+	  if (res.size () == 1) return res [0];
+	  std::sort (res.begin (), res.end (), detail::idLess);
+	  return efac.mkNary (PLUS (), res);
+	}
+      };
+
+      template <> struct Normalizer<MULT>
+      {
+	static Expr apply (ExprFactory &efac, ExprVector &args)
+	{
+	  detail::flatten<MULT> (args);
+
+	  mpz_class prod = 1;
+	  ExprVector res;
+	  forall (const Expr &a, args)
+	    {
+	      if (detail::isNum (a)) prod *= detail::num (a);
+	      else res.push_back (a);
+	    }
+
+	  if (res.empty () || prod == 0) return detail::mkNum (prod, efac);
+	  if (prod != 1) res.push_back (detail::mkNum (prod, efac));
+	  if (res.size () == 1) return res [0];
+	  std::sort (res.begin (), res.end (), detail::idLess);
+	  return efac.mkNary (MULT (), res);
+	}
+      };
+
+      template <> struct Normalizer<MINUS>
+      {
+	static Expr apply (ExprFactory &efac, ExprVector &args)
+	{
+	  if (args.size () == 2)
+	    {
+	      if (detail::isNum (args [1]) && detail::num (args [1]) == 0)
+		return args [0];
+	      if (detail::isNum (args [0]) && detail::isNum (args [1]))
+		return detail::mkNum (detail::num (args [0]) -
+				      detail::num (args [1]), efac);
+	    }
+	  return efac.mkNary (MINUS (), args);
+	}
+      };
+
+      template <> struct Normalizer<UN_MINUS>
+      {
+	static Expr apply (ExprFactory &efac, ExprVector &args)
+	{
+	  if (args.size () == 1)
+	    {
+	      if (detail::isNum (args [0]))
+		return detail::mkNum (-detail::num (args [0]), efac);
+	      if (isOpX<UN_MINUS> (args [0])) return args [0]->left ();
+	    }
+	  return efac.mkNary (UN_MINUS (), args);
+	}
+      };
+
+      /** comparisons of numerals are folded. The order of the
+	  arguments is kept */
+      template <typename T> struct CmpNormalizer
+      {
+	static Expr apply (ExprFactory &efac, ExprVector &args)
+	{
+	  if (args.size () == 2)
+	    {
+	      if (detail::isNum (args [0]) && detail::isNum (args [1]))
+		{
+		  int c = cmp (detail::num (args [0]), detail::num (args [1]));
+		  return detail::Cmp<T>::apply (c) ?
+		    expr::mk<TRUE> (efac) : expr::mk<FALSE> (efac);
+		}
+	      if (args [0] == args [1])
+		return detail::Cmp<T>::apply (0) ?
+		  expr::mk<TRUE> (efac) : expr::mk<FALSE> (efac);
+	    }
+	  return efac.mkNary (T (), args);
+	}
+      };
+      template <> struct Normalizer<EQ> : public CmpNormalizer<EQ> {};
+      template <> struct Normalizer<NEQ> : public CmpNormalizer<NEQ> {};
+      template <> struct Normalizer<LT> : public CmpNormalizer<LT> {};
+      template <> struct Normalizer<LEQ> : public CmpNormalizer<LEQ> {};
+      template <> struct Normalizer<GT> : public CmpNormalizer<GT> {};
+      template <> struct Normalizer<GEQ> : public CmpNormalizer<GEQ> {};
+
+      template <> struct Normalizer<NEG>
+      {
+	static Expr apply (ExprFactory &efac, ExprVector &args)
+	{
+	  if (args.size () == 1) return boolop::lneg (args [0]);
+	  return efac.mkNary (NEG (), args);
+	}
+      };
+
+      template <> struct Normalizer<IMPL>
+      {
+	static Expr apply (ExprFactory &efac, ExprVector &args)
+	{
+	  if (args.size () == 2) return boolop::limp (args [0], args [1]);
+	  return efac.mkNary (IMPL (), args);
+	}
+      };
+
+      template <typename T> Expr mk (Expr e)
+      {
+	ExprVector args (1, e);
+	return Normalizer<T>::apply (e->efac (), args);
+      }
+
+      template <typename T> Expr mk (Expr e1, Expr e2)
+      {
+	ExprVector args;
+	args.push_back (e1);
+	args.push_back (e2);
+	return Normalizer<T>::apply (e1->efac (), args);
+      }
+
+      template <typename T> Expr mk (Expr e1, Expr e2, Expr e3)
+      {
+	ExprVector args;
+	args.push_back (e1);
+	args.push_back (e2);
+	args.push_back (e3);
+	return Normalizer<T>::apply (e1->efac (), args);
+      }
+
+      /** Usage: norm::mknary<AND> (v.begin (), v.end ()) */
+      template <typename T, typename iterator>
+      Expr mknary (iterator bgn, iterator end)
+      {
+	assert (bgn != end);
+	ExprVector args (bgn, end);
+	return Normalizer<T>::apply (args [0]->efac (), args);
+      }
+
+      /** returns base if the range is empty */
+      template <typename T, typename iterator>
+      Expr mknary (Expr base, iterator bgn, iterator end)
+      {
+	if (bgn == end) return base;
+	return norm::mknary<T> (bgn, end);
+      }
+
+      template <typename T, typename Range>
+      Expr mknary (const Range &r)
+      { return norm::mknary<T> (boost::begin (r), boost::end (r)); }
+
+      template <typename T, typename Range>
+      Expr mknary (Expr base, const Range &r)
+      { return norm::mknary<T> (base, boost::begin (r), boost::end (r)); }
+    }
+  }
+}
+
+#endif
@@ -83,6 +83,8 @@ namespace ufo
         Z3_sort val_sort = reinterpret_cast<Z3_sort> (static_cast<Z3_ast> (_val_sort));
         res = reinterpret_cast<Z3_ast> (Z3_mk_array_sort (ctx, idx_sort, val_sort));       
       }
+      else if (isOpX<BVSORT> (e))
+        res = reinterpret_cast<Z3_ast> (Z3_mk_bv_sort (ctx, bv::width (e)));
       
       else if (isOpX<INT>(e))
 	{
@@ -353,17 +355,72 @@ namespace ufo
             res = Z3_mk_bvand (ctx, t1, t2);
           else if (isOpX<BOR> (e))
             res = Z3_mk_bvor (ctx, t1, t2);
+          else if (isOpX<BXOR> (e))
+            res = Z3_mk_bvxor (ctx, t1, t2);
+          else if (isOpX<BNAND> (e))
+            res = Z3_mk_bvnand (ctx, t1, t2);
+          else if (isOpX<BNOR> (e))
+            res = Z3_mk_bvnor (ctx, t1, t2);
+          else if (isOpX<BXNOR> (e))
+            res = Z3_mk_bvxnor (ctx, t1, t2);
+          else if (isOpX<BADD> (e))
+            res = Z3_mk_bvadd (ctx, t1, t2);
+          else if (isOpX<BSUB> (e))
+            res = Z3_mk_bvsub (ctx, t1, t2);
           else if (isOpX<BMUL> (e))
             res = Z3_mk_bvmul (ctx, t1, t2);
-          // XXX convert more bit-vector operations
+          else if (isOpX<BUDIV> (e))
+            res = Z3_mk_bvudiv (ctx, t1, t2);
+          else if (isOpX<BSDIV> (e))
+            res = Z3_mk_bvsdiv (ctx, t1, t2);
+          else if (isOpX<BUREM> (e))
+            res = Z3_mk_bvurem (ctx, t1, t2);
+          else if (isOpX<BSREM> (e))
+            res = Z3_mk_bvsrem (ctx, t1, t2);
+          else if (isOpX<BSMOD> (e))
+            res = Z3_mk_bvsmod (ctx, t1, t2);
+          else if (isOpX<BULT> (e))
+            res = Z3_mk_bvult (ctx, t1, t2);
+          else if (isOpX<BSLT> (e))
+            res = Z3_mk_bvslt (ctx, t1, t2);
+          else if (isOpX<BULE> (e))
+            res = Z3_mk_bvule (ctx, t1, t2);
+          else if (isOpX<BSLE> (e))
+            res = Z3_mk_bvsle (ctx, t1, t2);
+          else if (isOpX<BUGE> (e))
+            res = Z3_mk_bvuge (ctx, t1, t2);
+          else if (isOpX<BSGE> (e))
+            res = Z3_mk_bvsge (ctx, t1, t2);
+          else if (isOpX<BUGT> (e))
+            res = Z3_mk_bvugt (ctx, t1, t2);
+          else if (isOpX<BSGT> (e))
+            res = Z3_mk_bvsgt (ctx, t1, t2);
+          else if (isOpX<BCONCAT> (e))
+            res = Z3_mk_concat (ctx, t1, t2);
+          else if (isOpX<BSHL> (e))
+            res = Z3_mk_bvshl (ctx, t1, t2);
+          else if (isOpX<BSHR> (e))
+            res = Z3_mk_bvlshr (ctx, t1, t2);
+          else if (isOpX<BASHR> (e))
+            res = Z3_mk_bvashr (ctx, t1, t2);
 	  else
 	    return M::marshal (e, ctx, cache, seen);
 	}
+        else if (isOpX<BEXTRACT> (e))
+          {
+            assert (e->arity () == 3);
+            unsigned hi = getTerm<mpz_class> (e->arg (0)).get_ui ();
+            unsigned lo = getTerm<mpz_class> (e->arg (1)).get_ui ();
+            z3::ast arg = marshal (e->arg (2), ctx, cache, seen);
+            res = Z3_mk_extract (ctx, hi, lo, arg);
+          }
 	else if (isOpX<AND> (e) || isOpX<OR> (e) ||
 		 isOpX<ITE> (e) || isOpX<XOR> (e) ||
 		 isOpX<PLUS> (e) || isOpX<MINUS> (e) ||
 		 isOpX<MULT> (e) ||
-                 isOpX<STORE> (e) || isOpX<ARRAY_MAP> (e))
+                 isOpX<STORE> (e) || isOpX<ARRAY_MAP> (e) ||
+                 isOpX<BADD> (e) || isOpX<BMUL> (e) ||
+                 isOpX<BAND> (e) || isOpX<BOR> (e) || isOpX<BXOR> (e))
 	  {
 	    std::vector<z3::ast> pinned;
 	    std::vector<Z3_ast> args;
@@ -402,6 +459,20 @@ namespace ufo
                 Z3_func_decl fdecl = reinterpret_cast<Z3_func_decl> (args[0]);
                 res = Z3_mk_map (ctx, fdecl, e->arity ()-1, &args[1]);
               }
+            else
+              {
+                // -- n-ary bit-vector operators are left-associative
+                res = args [0];
+                for (size_t i = 1; i < args.size (); ++i)
+                  {
+                    if (isOp<BADD> (e)) res = Z3_mk_bvadd (ctx, res, args [i]);
+                    else if (isOp<BMUL> (e)) res = Z3_mk_bvmul (ctx, res, args [i]);
+                    else if (isOp<BAND> (e)) res = Z3_mk_bvand (ctx, res, args [i]);
+                    else if (isOp<BOR> (e)) res = Z3_mk_bvor (ctx, res, args [i]);
+                    else res = Z3_mk_bvxor (ctx, res, args [i]);
+                    pinned.push_back (z3::ast (ctx, res));
+                  }
+              }
 	  }
 	else
 	  return M::marshal (e, ctx, cache, seen);
@@ -595,6 +666,14 @@ namespace ufo
       }
       
 
+      if (dkind == Z3_OP_EXTRACT)
+      {
+        Expr arg = unmarshal (z3::ast (ctx, Z3_get_app_arg (ctx, app, 0)),
+                              efac, cache, seen);
+        return bv::extract (Z3_get_decl_int_parameter (ctx, fdecl, 0),
+                            Z3_get_decl_int_parameter (ctx, fdecl, 1), arg);
+      }
+
       if (dkind == Z3_OP_AS_ARRAY)
       {
         z3::ast zdecl 
@@ -697,7 +776,83 @@ namespace ufo
          case Z3_OP_BOR:
           e = mknary<BOR> (args.begin (), args.end ());
           break;
-          // XXX Add the rest of bv ops
+        case Z3_OP_BXOR:
+          e = mknary<BXOR> (args.begin (), args.end ());
+          break;
+        case Z3_OP_BNAND:
+          e = mknary<BNAND> (args.begin (), args.end ());
+          break;
+        case Z3_OP_BNOR:
+          e = mknary<BNOR> (args.begin (), args.end ());
+          break;
+        case Z3_OP_BXNOR:
+          e = mknary<BXNOR> (args.begin (), args.end ());
+          break;
+        case Z3_OP_BADD:
+          e = mknary<BADD> (args.begin (), args.end ());
+          break;
+        case Z3_OP_BSUB:
+          e = mknary<BSUB> (args.begin (), args.end ());
+          break;
+        case Z3_OP_BMUL:
+          e = mknary<BMUL> (args.begin (), args.end ());
+          break;
+        case Z3_OP_BUDIV:
+        case Z3_OP_BUDIV_I:
+          e = mknary<BUDIV> (args.begin (), args.end ());
+          break;
+        case Z3_OP_BSDIV:
+        case Z3_OP_BSDIV_I:
+          e = mknary<BSDIV> (args.begin (), args.end ());
+          break;
+        case Z3_OP_BUREM:
+        case Z3_OP_BUREM_I:
+          e = mknary<BUREM> (args.begin (), args.end ());
+          break;
+        case Z3_OP_BSREM:
+        case Z3_OP_BSREM_I:
+          e = mknary<BSREM> (args.begin (), args.end ());
+          break;
+        case Z3_OP_BSMOD:
+        case Z3_OP_BSMOD_I:
+          e = mknary<BSMOD> (args.begin (), args.end ());
+          break;
+        case Z3_OP_ULT:
+          e = mknary<BULT> (args.begin (), args.end ());
+          break;
+        case Z3_OP_SLT:
+          e = mknary<BSLT> (args.begin (), args.end ());
+          break;
+        case Z3_OP_ULEQ:
+          e = mknary<BULE> (args.begin (), args.end ());
+          break;
+        case Z3_OP_SLEQ:
+          e = mknary<BSLE> (args.begin (), args.end ());
+          break;
+        case Z3_OP_UGEQ:
+          e = mknary<BUGE> (args.begin (), args.end ());
+          break;
+        case Z3_OP_SGEQ:
+          e = mknary<BSGE> (args.begin (), args.end ());
+          break;
+        case Z3_OP_UGT:
+          e = mknary<BUGT> (args.begin (), args.end ());
+          break;
+        case Z3_OP_SGT:
+          e = mknary<BSGT> (args.begin (), args.end ());
+          break;
+        case Z3_OP_CONCAT:
+          e = mknary<BCONCAT> (args.begin (), args.end ());
+          break;
+        case Z3_OP_BSHL:
+          e = mknary<BSHL> (args.begin (), args.end ());
+          break;
+        case Z3_OP_BLSHR:
+          e = mknary<BSHR> (args.begin (), args.end ());
+          break;
+        case Z3_OP_BASHR:
+          e = mknary<BASHR> (args.begin (), args.end ());
+          break;
 	default:
 	  return U::unmarshal (z, efac, cache, seen);
 	}
@@ -0,0 +1,84 @@
+#include "seahorn/ExprOrder.hh"
+
+#include <boost/functional/hash.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <typeinfo>
+
+namespace seahorn
+{
+  size_t ExprOrder::digest (Expr e)
+  {
+    auto it = m_digests.find (&*e);
+    if (it != m_digests.end ()) return it->second;
+
+    // -- post-order with an explicit stack. The flag is set once the
+    // -- children of the node have been pushed
+    std::vector<std::pair<ENode*, bool> > stack;
+    stack.push_back (std::make_pair (&*e, false));
+    while (!stack.empty ())
+    {
+      ENode *n = stack.back ().first;
+      if (m_digests.count (n))
+      {
+        stack.pop_back ();
+        continue;
+      }
+
+      if (!stack.back ().second)
+      {
+        stack.back ().second = true;
+        for (size_t i = n->arity (); i > 0; --i)
+          if (!m_digests.count (n->arg (i - 1)))
+            stack.push_back (std::make_pair (n->arg (i - 1), false));
+        continue;
+      }
+
+      stack.pop_back ();
+      size_t h = boost::hash<std::string> () (typeid (n->op ()).name ());
+      if (n->arity () == 0)
+        boost::hash_combine (h, boost::lexical_cast<std::string> (*n));
+      for (ENode::args_iterator b = n->args_begin (), end = n->args_end ();
+           b != end; ++b)
+        boost::hash_combine (h, m_digests.at (*b));
+      m_digests [n] = h;
+      m_nodes.push_back (n);
+    }
+    return m_digests.at (&*e);
+  }
+
+  bool ExprOrder::structLess (Expr a, Expr b)
+  {
+    std::string ta = typeid (a->op ()).name ();
+    std::string tb = typeid (b->op ()).name ();
+    if (ta != tb) return ta < tb;
+    if (a->arity () != b->arity ()) return a->arity () < b->arity ();
+
+    if (a->arity () == 0)
+    {
+      std::string sa = boost::lexical_cast<std::string> (*a);
+      std::string sb = boost::lexical_cast<std::string> (*b);
+      if (sa != sb) return sa < sb;
+    }
+    for (size_t i = 0; i < a->arity (); ++i)
+      if (a->arg (i) != b->arg (i)) return less (a->arg (i), b->arg (i));
+
+    return a->getId () < b->getId ();
+  }
+
+  bool ExprOrder::less (Expr a, Expr b)
+  {
+    if (a == b) return false;
+    size_t da = digest (a);
+    size_t db = digest (b);
+    if (da != db) return da < db;
+    return structLess (a, b);
+  }
+
+  void ExprOrder::sort (ExprVector &v)
+  {
+    std::sort (v.begin (), v.end (),
+               [this] (const Expr &a, const Expr &b) { return less (a, b); });
+  }
+}
@@ -0,0 +1,532 @@
+#include "seahorn/ExprSerialize.hh"
+
+#include "llvm/IR/Function.h"
+#include "llvm/IR/BasicBlock.h"
+#include "llvm/IR/ValueSymbolTable.h"
+
+#include <boost/lexical_cast.hpp>
+#include <boost/range/iterator_range.hpp>
+
+#include <map>
+#include <typeindex>
+
+namespace seahorn
+{
+  namespace
+  {
+    /// how the payload of a node is interpreted
+    enum OpKind { PLAIN, T_STRING, T_INT, T_ULONG, T_MPZ, T_MPQ,
+                  T_BVAR, T_BVSORT, T_FUNCTION, T_BB, T_VALUE };
+
+    struct OpInfo
+    {
+      const char *name;
+      OpKind kind;
+      /// operator of a PLAIN node
+      const Operator *op;
+    };
+
+#define SER_OP(NAME) {#NAME, PLAIN, &NAME::instance ()}
+#define SER_TERM(NAME) {#NAME, T_ ## NAME, nullptr}
+
+    /// Operators that can be serialized. Files refer to them by name,
+    /// so the order does not matter
+    const OpInfo g_ops [] =
+    {
+      SER_TERM(STRING), SER_TERM(INT), SER_TERM(ULONG), SER_TERM(MPZ),
+      SER_TERM(MPQ), SER_TERM(BVAR), SER_TERM(BVSORT), SER_TERM(FUNCTION),
+      SER_TERM(BB), SER_TERM(VALUE),
+
+      SER_OP(TRUE), SER_OP(FALSE), SER_OP(AND), SER_OP(OR), SER_OP(XOR),
+      SER_OP(NEG), SER_OP(IMPL), SER_OP(ITE), SER_OP(IFF),
+
+      SER_OP(PLUS), SER_OP(MINUS), SER_OP(MULT), SER_OP(DIV), SER_OP(IDIV),
+      SER_OP(MOD), SER_OP(UN_MINUS), SER_OP(ABS), SER_OP(PINFTY),
+      SER_OP(NINFTY), SER_OP(ITV),
+
+      SER_OP(EQ), SER_OP(NEQ), SER_OP(LEQ), SER_OP(GEQ), SER_OP(LT),
+      SER_OP(GT),
+
+      SER_OP(NONDET), SER_OP(ASM), SER_OP(TUPLE), SER_OP(VARIANT),
+
+      SER_OP(INT_TY), SER_OP(CHAR_TY), SER_OP(REAL_TY), SER_OP(VOID_TY),
+      SER_OP(BOOL_TY), SER_OP(UNINT_TY), SER_OP(ARRAY_TY),
+
+      SER_OP(SELECT), SER_OP(STORE), SER_OP(CONST_ARRAY), SER_OP(ARRAY_MAP),
+      SER_OP(ARRAY_DEFAULT), SER_OP(AS_ARRAY),
+
+      SER_OP(BIND), SER_OP(SCOPE), SER_OP(FDECL), SER_OP(FAPP),
+
+      SER_OP(BNOT), SER_OP(BREDAND), SER_OP(BREDOR), SER_OP(BAND),
+      SER_OP(BOR), SER_OP(BXOR), SER_OP(BNAND), SER_OP(BNOR), SER_OP(BXNOR),
+      SER_OP(BNEG), SER_OP(BADD), SER_OP(BSUB), SER_OP(BMUL), SER_OP(BUDIV),
+      SER_OP(BSDIV), SER_OP(BUREM), SER_OP(BSREM), SER_OP(BSMOD),
+      SER_OP(BULT), SER_OP(BSLT), SER_OP(BULE), SER_OP(BSLE), SER_OP(BUGE),
+      SER_OP(BSGE), SER_OP(BUGT), SER_OP(BSGT), SER_OP(BCONCAT),
+      SER_OP(BEXTRACT), SER_OP(BSEXT), SER_OP(BZEXT), SER_OP(BREPEAT),
+      SER_OP(BSHL), SER_OP(BSHR), SER_OP(BASHR), SER_OP(BROTATE_LEFT),
+      SER_OP(BROTATE_RIGHT), SER_OP(BEXT_ROTATE_LEFT),
+      SER_OP(BEXT_ROTATE_RIGHT), SER_OP(INT2BV), SER_OP(BV2INT)
+    };
+
+#undef SER_OP
+#undef SER_TERM
+
+    class OpRegistry
+    {
+      std::map<std::type_index, const OpInfo*> m_byType;
+      std::map<std::string, const OpInfo*> m_byName;
+
+      OpRegistry ()
+      {
+        for (const OpInfo &info : g_ops)
+        {
+          m_byName [info.name] = &info;
+          if (info.op) m_byType [std::type_index (typeid (*info.op))] = &info;
+        }
+      }
+
+    public:
+      static const OpRegistry &get ()
+      {
+        static const OpRegistry reg;
+        return reg;
+      }
+
+      const OpInfo *byName (const std::string &name) const
+      {
+        auto it = m_byName.find (name);
+        return it == m_byName.end () ? nullptr : it->second;
+      }
+
+      const OpInfo *byOp (const Operator &op) const
+      {
+        auto it = m_byType.find (std::type_index (typeid (op)));
+        return it == m_byType.end () ? nullptr : it->second;
+      }
+    };
+
+    /// the function that contains v, if any
+    const llvm::Function *parent (const llvm::Value *v)
+    {
+      if (const llvm::Instruction *inst = llvm::dyn_cast<llvm::Instruction> (v))
+        return inst->getParent () ? inst->getParent ()->getParent () : nullptr;
+      if (const llvm::Argument *arg = llvm::dyn_cast<llvm::Argument> (v))
+        return arg->getParent ();
+      if (const llvm::BasicBlock *bb = llvm::dyn_cast<llvm::BasicBlock> (v))
+        return bb->getParent ();
+      return nullptr;
+    }
+
+    std::string parentName (const llvm::Value *v)
+    {
+      const llvm::Function *fn = parent (v);
+      return fn ? fn->getName ().str () : std::string ();
+    }
+
+    /// how a VALUE node refers to its value
+    enum ValueRef { BY_PRINTED_NAME = 0, BY_NAME = 1, BY_SLOT = 2 };
+  }
+
+  const llvm::Function *ExprValueResolver::function (llvm::StringRef name) const
+  { return m_module.getFunction (name); }
+
+  const llvm::Value *ExprValueResolver::value (llvm::StringRef fn,
+                                               llvm::StringRef name) const
+  {
+    if (fn.empty ()) return m_module.getNamedValue (name);
+
+    const llvm::Function *f = m_module.getFunction (fn);
+    if (!f) return nullptr;
+    return f->getValueSymbolTable ().lookup (name);
+  }
+
+  const llvm::Value *ExprValueResolver::slot (llvm::StringRef fn,
+                                              uint32_t n) const
+  {
+    const llvm::Function *f = m_module.getFunction (fn);
+    if (!f) return nullptr;
+
+    // -- arguments first, then the instructions in order
+    if (n < f->arg_size ())
+    {
+      llvm::Function::const_arg_iterator it = f->arg_begin ();
+      std::advance (it, n);
+      return &*it;
+    }
+    n -= f->arg_size ();
+    for (const llvm::BasicBlock &bb : *f)
+    {
+      if (n < bb.size ())
+      {
+        llvm::BasicBlock::const_iterator it = bb.begin ();
+        std::advance (it, n);
+        return &*it;
+      }
+      n -= bb.size ();
+    }
+    return nullptr;
+  }
+
+  uint32_t ExprWriter::string (const std::string &s)
+  {
+    auto it = m_stringIds.find (s);
+    if (it != m_stringIds.end ()) return it->second;
+
+    uint32_t id = m_strings.size ();
+    m_strings.push_back (s);
+    m_stringIds [s] = id;
+    return id;
+  }
+
+  uint32_t ExprWriter::opCode (const std::string &name)
+  {
+    auto it = m_opIds.find (name);
+    if (it != m_opIds.end ()) return it->second;
+
+    uint32_t code = m_ops.size ();
+    m_ops.push_back (string (name));
+    m_opIds [name] = code;
+    return code;
+  }
+
+  uint32_t ExprWriter::slot (const llvm::Function &fn, const llvm::Value *v)
+  {
+    if (m_numbered.insert (&fn).second)
+    {
+      uint32_t n = 0;
+      for (const llvm::Argument &arg :
+             boost::make_iterator_range (fn.arg_begin (), fn.arg_end ()))
+        m_slots [&arg] = n++;
+      for (const llvm::BasicBlock &bb : fn)
+        for (const llvm::Instruction &inst : bb) m_slots [&inst] = n++;
+    }
+    return m_slots.at (v);
+  }
+
+  void ExprWriter::node (Expr e)
+  {
+    std::vector<uint32_t> w;
+    std::string op;
+
+    if (isOpX<STRING> (e))
+    {
+      op = "STRING";
+      w.push_back (string (getTerm<std::string> (e)));
+    }
+    else if (isOpX<INT> (e))
+    {
+      op = "INT";
+      w.push_back (static_cast<uint32_t> (getTerm<int> (e)));
+    }
+    else if (isOpX<ULONG> (e))
+    {
+      op = "ULONG";
+      uint64_t v = getTerm<unsigned long> (e);
+      w.push_back (static_cast<uint32_t> (v));
+      w.push_back (static_cast<uint32_t> (v >> 32));
+    }
+    else if (isOpX<MPZ> (e))
+    {
+      op = "MPZ";
+      w.push_back (string (getTerm<mpz_class> (e).get_str ()));
+    }
+    else if (isOpX<MPQ> (e))
+    {
+      op = "MPQ";
+      w.push_back (string (getTerm<mpq_class> (e).get_str ()));
+    }
+    else if (isOpX<BVAR> (e))
+    {
+      op = "BVAR";
+      w.push_back (getTerm<bind::BoundVar> (e).var);
+    }
+    else if (isOpX<BVSORT> (e))
+    {
+      op = "BVSORT";
+      w.push_back (getTerm<const bv::BvSort> (e).m_width);
+    }
+    else if (isOpX<FUNCTION> (e))
+    {
+      op = "FUNCTION";
+      w.push_back (string (getTerm<const llvm::Function*> (e)->getName ().str ()));
+    }
+    else if (isOpX<BB> (e))
+    {
+      op = "BB";
+      const llvm::BasicBlock *bb = getTerm<const llvm::BasicBlock*> (e);
+      w.push_back (string (parentName (bb)));
+      w.push_back (string (bb->getName ().str ()));
+      w.push_back (string (boost::lexical_cast<std::string> (*e)));
+    }
+    else if (isOpX<VALUE> (e))
+    {
+      op = "VALUE";
+      const llvm::Value *v = getTerm<const llvm::Value*> (e);
+      const llvm::Function *fn = parent (v);
+      w.push_back (string (fn ? fn->getName ().str () : std::string ()));
+      // -- unnamed values, such as constant expressions, are only
+      // -- known by their printed name
+      if (v->hasName ())
+      {
+        w.push_back (BY_NAME);
+        w.push_back (string (v->getName ().str ()));
+      }
+      else if (fn)
+      {
+        w.push_back (BY_SLOT);
+        w.push_back (slot (*fn, v));
+      }
+      else
+      {
+        w.push_back (BY_PRINTED_NAME);
+        w.push_back (string (std::string ()));
+      }
+      w.push_back (string (boost::lexical_cast<std::string> (*e)));
+    }
+    else if (const OpInfo *info = OpRegistry::get ().byOp (e->op ()))
+    {
+      op = info->name;
+      for (ENode::args_iterator b = e->args_begin (), end = e->args_end ();
+           b != end; ++b)
+        w.push_back (m_ids.at (*b));
+    }
+    else
+    {
+      // -- other nodes cannot be read back. They are kept by their
+      // -- printed name so that the section is still well formed
+      m_ok = false;
+      op = "STRING";
+      w.push_back (string (boost::lexical_cast<std::string> (*e)));
+    }
+
+    m_nodes.push_back (opCode (op));
+    m_nodes.push_back (w.size ());
+    m_nodes.insert (m_nodes.end (), w.begin (), w.end ());
+    m_ids [&*e] = m_numNodes++;
+  }
+
+  uint32_t ExprWriter::add (Expr e)
+  {
+    // -- post-order with an explicit stack. The flag is set once the
+    // -- children of the node have been pushed
+    std::vector<std::pair<ENode*, bool> > stack;
+    stack.push_back (std::make_pair (&*e, false));
+    while (!stack.empty ())
+    {
+      ENode *n = stack.back ().first;
+      if (m_ids.count (n))
+      {
+        stack.pop_back ();
+        continue;
+      }
+
+      if (!stack.back ().second)
+      {
+        stack.back ().second = true;
+        for (size_t i = n->arity (); i > 0; --i)
+          if (!m_ids.count (n->arg (i - 1)))
+            stack.push_back (std::make_pair (n->arg (i - 1), false));
+        continue;
+      }
+
+      stack.pop_back ();
+      node (n);
+    }
+    return m_ids.at (&*e);
+  }
+
+  void ExprWriter::write (llvm::raw_ostream &out) const
+  {
+    std::vector<uint32_t> hdr;
+
+    // -- string table: offsets, then the characters padded to a word
+    std::string chars;
+    hdr.push_back (m_strings.size ());
+    for (const std::string &s : m_strings) chars += s;
+    hdr.push_back (chars.size ());
+    uint32_t off = 0;
+    hdr.push_back (off);
+    for (const std::string &s : m_strings) hdr.push_back (off += s.size ());
+    chars.resize ((chars.size () + 3) / 4 * 4, '\0');
+
+    out.write (reinterpret_cast<const char*> (hdr.data ()),
+               hdr.size () * sizeof (uint32_t));
+    out.write (chars.data (), chars.size ());
+
+    // -- operators and nodes
+    std::vector<uint32_t> ops;
+    ops.push_back (m_ops.size ());
+    ops.insert (ops.end (), m_ops.begin (), m_ops.end ());
+    ops.push_back (m_numNodes);
+    ops.push_back (m_nodes.size ());
+    out.write (reinterpret_cast<const char*> (ops.data ()),
+               ops.size () * sizeof (uint32_t));
+    out.write (reinterpret_cast<const char*> (m_nodes.data ()),
+               m_nodes.size () * sizeof (uint32_t));
+  }
+
+  const uint32_t *ExprReader::read (const uint32_t *p, const uint32_t *end)
+  {
+    // -- string table
+    if (end - p < 2) return nullptr;
+    uint32_t numStrings = *p++;
+    uint32_t numChars = *p++;
+    if (static_cast<uint64_t> (end - p) < numStrings + 1ull) return nullptr;
+    const uint32_t *offsets = p;
+    p += numStrings + 1;
+    uint32_t charWords = (numChars + 3) / 4;
+    if (static_cast<uint64_t> (end - p) < charWords) return nullptr;
+    const char *chars = reinterpret_cast<const char*> (p);
+    p += charWords;
+
+    for (uint32_t i = 0; i < numStrings; ++i)
+      if (offsets [i] > offsets [i + 1] || offsets [i + 1] > numChars)
+        return nullptr;
+    auto str = [&] (uint32_t i)
+      { return llvm::StringRef (chars + offsets [i], offsets [i + 1] - offsets [i]); };
+
+    // -- operators
+    if (end - p < 1) return nullptr;
+    uint32_t numOps = *p++;
+    if (static_cast<uint64_t> (end - p) < numOps) return nullptr;
+    std::vector<const OpInfo*> ops;
+    for (uint32_t i = 0; i < numOps; ++i, ++p)
+    {
+      if (*p >= numStrings) return nullptr;
+      const OpInfo *info = OpRegistry::get ().byName (str (*p).str ());
+      if (!info)
+      {
+        llvm::errs () << "ERROR: unknown operator " << str (*p) << "\n";
+        return nullptr;
+      }
+      ops.push_back (info);
+    }
+
+    // -- nodes
+    if (end - p < 2) return nullptr;
+    uint32_t numNodes = *p++;
+    uint32_t numWords = *p++;
+    if (static_cast<uint64_t> (end - p) < numWords) return nullptr;
+    const uint32_t *q = p;
+    const uint32_t *qend = p + numWords;
+    p = qend;
+
+    m_nodes.clear ();
+    m_nodes.reserve (numNodes);
+    m_unresolved = 0;
+    ExprVector kids;
+    for (uint32_t i = 0; i < numNodes; ++i)
+    {
+      if (qend - q < 2 || q [0] >= ops.size ()) return nullptr;
+      const OpInfo &info = *ops [q [0]];
+      uint32_t n = q [1];
+      q += 2;
+      if (static_cast<uint64_t> (qend - q) < n) return nullptr;
+      const uint32_t *w = q;
+      q += n;
+
+      // -- check the references of the payload
+      if (info.kind == PLAIN)
+      {
+        for (uint32_t j = 0; j < n; ++j)
+          if (w [j] >= i) return nullptr;
+      }
+      else
+      {
+        static const uint32_t words [] = {0, 1, 1, 2, 1, 1, 1, 1, 1, 3, 4};
+        if (n != words [info.kind]) return nullptr;
+        if ((info.kind == T_STRING || info.kind == T_MPZ ||
+             info.kind == T_MPQ || info.kind == T_FUNCTION) &&
+            w [0] >= numStrings)
+          return nullptr;
+        if (info.kind == T_BB &&
+            (w [0] >= numStrings || w [1] >= numStrings || w [2] >= numStrings))
+          return nullptr;
+        if (info.kind == T_VALUE &&
+            (w [0] >= numStrings || w [1] > BY_SLOT || w [3] >= numStrings ||
+             (w [1] != BY_SLOT && w [2] >= numStrings)))
+          return nullptr;
+      }
+
+      Expr e;
+      switch (info.kind)
+      {
+      case PLAIN:
+        kids.clear ();
+        for (uint32_t j = 0; j < n; ++j) kids.push_back (m_nodes [w [j]]);
+        e = kids.empty () ? m_efac.mkTerm (*info.op) :
+          m_efac.mkNary (*info.op, kids.begin (), kids.end ());
+        break;
+      case T_STRING:
+        e = mkTerm<std::string> (str (w [0]).str (), m_efac);
+        break;
+      case T_INT:
+        e = mkTerm<int> (static_cast<int> (w [0]), m_efac);
+        break;
+      case T_ULONG:
+        e = mkTerm<unsigned long>
+          (static_cast<unsigned long> (w [0]) |
+           (static_cast<unsigned long> (static_cast<uint64_t> (w [1]) << 32)),
+           m_efac);
+        break;
+      case T_MPZ:
+        {
+          mpz_class v;
+          if (v.set_str (str (w [0]).str (), 10) != 0) return nullptr;
+          e = mkTerm<mpz_class> (v, m_efac);
+        }
+        break;
+      case T_MPQ:
+        {
+          mpq_class v;
+          if (v.set_str (str (w [0]).str (), 10) != 0) return nullptr;
+          e = mkTerm<mpq_class> (v, m_efac);
+        }
+        break;
+      case T_BVAR:
+        e = mkTerm (bind::BoundVar (w [0]), m_efac);
+        break;
+      case T_BVSORT:
+        e = bv::bvsort (w [0], m_efac);
+        break;
+      case T_FUNCTION:
+        {
+          const llvm::Function *f =
+            m_resolver ? m_resolver->function (str (w [0])) : nullptr;
+          if (m_resolver && !f) ++m_unresolved;
+          e = f ? mkTerm<const llvm::Function*> (f, m_efac) :
+            mkTerm<std::string> (str (w [0]).str (), m_efac);
+        }
+        break;
+      case T_BB:
+        {
+          const llvm::BasicBlock *bb = nullptr;
+          if (m_resolver)
+            bb = llvm::dyn_cast_or_null<llvm::BasicBlock>
+              (m_resolver->value (str (w [0]), str (w [1])));
+          if (m_resolver && !bb) ++m_unresolved;
+          e = bb ? mkTerm<const llvm::BasicBlock*> (bb, m_efac) :
+            mkTerm<std::string> (str (w [2]).str (), m_efac);
+        }
+        break;
+      case T_VALUE:
+        {
+          const llvm::Value *v = nullptr;
+          if (m_resolver && w [1] == BY_NAME)
+            v = m_resolver->value (str (w [0]), str (w [2]));
+          else if (m_resolver && w [1] == BY_SLOT)
+            v = m_resolver->slot (str (w [0]), w [2]);
+          if (m_resolver && !v) ++m_unresolved;
+          e = v ? mkTerm<const llvm::Value*> (v, m_efac) :
+            mkTerm<std::string> (str (w [3]).str (), m_efac);
+        }
+        break;
+      }
+      m_nodes.push_back (e);
+    }
+
+    if (q != qend) return nullptr;
+    return p;
+  }
+}
@@ -2,6 +2,7 @@
 #include "seahorn/LiveSymbols.hh"
 #include "seahorn/Support/CFG.hh"
 #include "seahorn/Support/ExprSeahorn.hh"
+#include "ufo/ExprNorm.hpp"
 
 namespace seahorn
 {
@@ -103,7 +104,7 @@ namespace seahorn
           ExprVector side;
           side.push_back (boolop::lneg ((s.read (m_sem.errorFlag (cp.bb ())))));
           lsem.execCpEdg (s, *edge, side);
-          Expr tau = mknary<AND> (mk<TRUE> (m_efac), side);
+          Expr tau = norm::mknary<AND> (mk<TRUE> (m_efac), side);
           expr::filter (tau, bind::IsConst(), 
                         std::inserter (allVars, allVars.begin ()));
 
@@ -17,6 +17,7 @@
 #include <boost/algorithm/string/predicate.hpp>
 
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/ToolOutputFile.h"
 #include "llvm/Support/FileSystem.h"
 
@@ -178,6 +179,9 @@ namespace seahorn
   
   bool HornCex::runOnModule (Module &M)
   {
+    // -- the counterexample is mapped back to blocks by their predicates
+    if (getAnalysis<HornifyModule> ().isLoaded ())
+      report_fatal_error ("-horn-cex cannot be used with -horn-load-db");
     for (Function &F : M)
       if (F.getName ().equals ("main")) return runOnFunction (F);
     return false;
@@ -346,6 +350,9 @@ namespace seahorn
     
     
     ExprFactory &efac = hm.getExprFactory ();
+    // -- terms built to validate the trace are released at once when
+    // -- the function returns. Nothing below may keep them longer
+    ExprFactory::ScopedArena arena (efac);
     
     // -- local symbolic execution engine.
     // -- possibly different from the one used to solve the problem
@@ -374,7 +381,9 @@ namespace seahorn
     }
     
     
-    ZSolver<EZ3> solver (hm.getZContext ());
+    // -- own context so that its cache does not outlive the arena
+    EZ3 zctx (efac);
+    ZSolver<EZ3> solver (zctx);
     ExprVector assumptions;
     assumptions.reserve (side.size ());
     for (Expr v : side) 
@@ -1,20 +1,128 @@
 #include "seahorn/HornClauseDB.hh"
+#include "seahorn/ExprSerialize.hh"
+
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ToolOutputFile.h"
 
 #include <boost/range.hpp>
 #include <boost/range/algorithm/sort.hpp>
 #include <boost/range/algorithm/copy.hpp>
 
+#include <cstring>
 #include <sstream>
 
 namespace seahorn
 {
-  const ExprVector &HornClauseDB::getVars () const
+  namespace
+  {
+    /// "SHDB" as a little-endian word
+    const uint32_t DB_MAGIC = 0x42444853;
+    const uint32_t DB_VERSION = 1;
+    const uint32_t NO_EXPR = 0xFFFFFFFF;
+  }
+  
+  void HornClauseDB::registerRelation (Expr fdecl)
   {
-    boost::sort (m_vars);
-    m_vars.resize (std::distance (m_vars.begin (),
-                                  std::unique (m_vars.begin (),
-                                               m_vars.end ())));
-    return m_vars;
+    if (m_relSet.insert (fdecl).second) m_rels.push_back (fdecl);
+  }
+  
+  void HornClauseDB::bodyRelations (const HornRule &rule, ExprSet &out) const
+  {
+    // -- every predicate application is indexed, so that the rules
+    // -- that were added before their relations are found later
+    ExprVector apps;
+    filter (rule.body (), 
+            [] (Expr e) 
+            {return bind::isFapp (e) && 
+                isOpX<BOOL_TY> (bind::rangeTy (bind::fname (e)));},
+            std::back_inserter (apps));
+    for (auto &app : apps) out.insert (bind::fname (app));
+  }
+  
+  HornClauseDB::RuleId HornClauseDB::addRule (HornRule rule)
+  {
+    RuleId id = m_rules.size ();
+    m_rules.push_back (rule);
+    ++m_numRules;
+    for (auto &v : rule.vars ())
+      if (m_varRules [v]++ == 0) m_vars.insert (v);
+    
+    if (bind::isFapp (rule.head ())) 
+      m_heads [bind::fname (rule.head ())].push_back (id);
+    ExprSet rels;
+    bodyRelations (rule, rels);
+    for (auto &r : rels) m_bodies [r].push_back (id);
+    return id;
+  }
+  
+  void HornClauseDB::removeRule (RuleId id)
+  {
+    assert (id < m_rules.size ());
+    if (isRemoved (id)) return;
+    for (auto &v : m_rules [id].vars ())
+      if (--m_varRules [v] == 0)
+      {
+        m_varRules.erase (v);
+        m_vars.erase (v);
+      }
+    // -- the indexes are cleaned lazily
+    m_rules [id].clear ();
+    --m_numRules;
+  }
+  
+  void HornClauseDB::removeRule (const HornRule &r)
+  {
+    // -- heads that are not applications, such as false, are not
+    // -- indexed
+    RuleIdVector ids = bind::isFapp (r.head ()) ?
+      getHeadRules (bind::fname (r.head ())) : getRuleIds ();
+    for (RuleId id : ids)
+      if (m_rules [id] == r) removeRule (id);
+  }
+  
+  void HornClauseDB::reset ()
+  {
+    m_rels.clear ();
+    m_relSet.clear ();
+    m_rules.clear ();
+    m_heads.clear ();
+    m_bodies.clear ();
+    m_numRules = 0;
+    m_vars.clear ();
+    m_varRules.clear ();
+    m_query.reset ();
+    m_constraints.clear ();
+  }
+
+  void HornClauseDB::merge (const HornClauseDB &o)
+  {
+    for (auto &r : o.getRelations ()) registerRelation (r);
+    for (auto &rule : o.getRules ()) addRule (rule);
+    if (o.hasQuery ()) m_query = o.m_query;
+    for (auto &kv : o.m_constraints)
+      m_constraints [kv.first].insert (m_constraints [kv.first].end (),
+                                       kv.second.begin (), kv.second.end ());
+  }
+  
+  HornClauseDB::RuleIdVector HornClauseDB::getRuleIds () const
+  {
+    RuleIdVector res;
+    res.reserve (m_numRules);
+    for (RuleId id = 0; id < m_rules.size (); ++id)
+      if (!isRemoved (id)) res.push_back (id);
+    return res;
+  }
+  
+  HornClauseDB::RuleIdVector HornClauseDB::live (const RuleIndex &idx, 
+                                                 Expr fdecl) const
+  {
+    RuleIdVector res;
+    auto it = idx.find (fdecl);
+    if (it == idx.end ()) return res;
+    for (RuleId id : it->second)
+      if (!isRemoved (id)) res.push_back (id);
+    return res;
   }
 
   void HornClauseDB::addConstraint (Expr pred, Expr lemma)
@@ -57,6 +165,191 @@ namespace seahorn
     return replace (lemma, sub);
   }
   
+  /// The file is a header (magic, version), an expression section,
+  /// and the database as indices of expressions:
+  ///   #relations, relations...
+  ///   #rules, for each rule: #vars, vars..., head, body
+  ///   query or NO_EXPR
+  ///   #constrained relations, for each: relation, #lemmas, lemmas...
+  void HornClauseDB::save (ExprWriter &w, std::vector<uint32_t> &db) const
+  {
+    db.push_back (m_rels.size ());
+    for (auto &r : m_rels) db.push_back (w.add (r));
+    
+    db.push_back (m_numRules);
+    for (auto &rule : getRules ())
+    {
+      db.push_back (rule.vars ().size ());
+      for (auto &v : rule.vars ()) db.push_back (w.add (v));
+      db.push_back (w.add (rule.head ()));
+      db.push_back (w.add (rule.body ()));
+    }
+    
+    db.push_back (hasQuery () ? w.add (m_query) : NO_EXPR);
+    
+    db.push_back (m_constraints.size ());
+    for (auto &kv : m_constraints)
+    {
+      db.push_back (w.add (kv.first));
+      db.push_back (kv.second.size ());
+      for (auto &lemma : kv.second) db.push_back (w.add (lemma));
+    }
+  }
+  
+  bool HornClauseDB::save (StringRef file) const
+  {
+    ExprWriter w;
+    std::vector<uint32_t> db;
+    save (w, db);
+    
+    if (!w.ok ())
+    {
+      errs () << "ERROR: Cannot serialize Horn clauses\n";
+      return false;
+    }
+    
+    std::error_code ec;
+    llvm::tool_output_file out (file.str ().c_str (), ec, llvm::sys::fs::F_None);
+    if (ec)
+    {
+      errs () << "ERROR: Cannot open " << file << ": " << ec.message () << "\n";
+      return false;
+    }
+    
+    const uint32_t hdr [] = {DB_MAGIC, DB_VERSION};
+    out.os ().write (reinterpret_cast<const char*> (hdr), sizeof (hdr));
+    w.write (out.os ());
+    out.os ().write (reinterpret_cast<const char*> (db.data ()),
+                     db.size () * sizeof (uint32_t));
+    out.keep ();
+    return true;
+  }
+  
+  const uint32_t *HornClauseDB::load (const ExprReader &reader,
+                                      const uint32_t *p, const uint32_t *end)
+  {
+    auto word = [&] (uint32_t &w)
+      {
+        if (!p || p == end) return false;
+        w = *p++;
+        return true;
+      };
+    auto expr = [&] (Expr &e)
+      {
+        uint32_t idx;
+        if (!word (idx)) return false;
+        e = reader.get (idx);
+        return e != nullptr;
+      };
+    
+    ExprVector rels;
+    RuleVector rules;
+    Expr query;
+    std::map<Expr, ExprVector> constraints;
+    
+    bool ok = true;
+    uint32_t n = 0;
+    ok = ok && word (n);
+    for (uint32_t i = 0; ok && i < n; ++i)
+    {
+      Expr r;
+      ok = expr (r);
+      rels.push_back (r);
+    }
+    
+    ok = ok && word (n);
+    for (uint32_t i = 0; ok && i < n; ++i)
+    {
+      ExprVector vars;
+      uint32_t sz = 0;
+      ok = word (sz);
+      for (uint32_t j = 0; ok && j < sz; ++j)
+      {
+        Expr v;
+        ok = expr (v);
+        vars.push_back (v);
+      }
+      Expr head, body;
+      ok = ok && expr (head) && expr (body);
+      if (ok) rules.push_back (HornRule (vars, head, body));
+    }
+    
+    uint32_t q = 0;
+    ok = ok && word (q);
+    if (ok && q != NO_EXPR) 
+    {
+      query = reader.get (q);
+      ok = query != nullptr;
+    }
+    
+    ok = ok && word (n);
+    for (uint32_t i = 0; ok && i < n; ++i)
+    {
+      Expr reln;
+      uint32_t sz = 0;
+      ok = expr (reln) && word (sz);
+      for (uint32_t j = 0; ok && j < sz; ++j)
+      {
+        Expr lemma;
+        ok = expr (lemma);
+        constraints [reln].push_back (lemma);
+      }
+    }
+    
+    if (!ok) return nullptr;
+    
+    reset ();
+    for (auto &r : rels) registerRelation (r);
+    for (auto &rule : rules) addRule (rule);
+    m_query = query;
+    m_constraints.swap (constraints);
+    return p;
+  }
+  
+  bool HornClauseDB::load (StringRef file, const ExprValueResolver *resolver)
+  {
+    // -- large files are mapped in memory
+    ErrorOr<std::unique_ptr<MemoryBuffer> > buf = 
+      MemoryBuffer::getFile (file, -1, false);
+    if (!buf)
+    {
+      errs () << "ERROR: Cannot read " << file << ": " 
+              << buf.getError ().message () << "\n";
+      return false;
+    }
+    
+    StringRef data = (*buf)->getBuffer ();
+    // -- the words are read in place unless the buffer is not aligned
+    std::vector<uint32_t> copy;
+    const uint32_t *p = reinterpret_cast<const uint32_t*> (data.data ());
+    if (reinterpret_cast<uintptr_t> (p) % alignof (uint32_t) != 0)
+    {
+      copy.resize (data.size () / sizeof (uint32_t));
+      std::memcpy (copy.data (), data.data (), copy.size () * sizeof (uint32_t));
+      p = copy.data ();
+    }
+    const uint32_t *end = p + data.size () / sizeof (uint32_t);
+    
+    if (data.size () % sizeof (uint32_t) != 0 || end - p < 2 ||
+        p [0] != DB_MAGIC || p [1] != DB_VERSION)
+    {
+      errs () << "ERROR: " << file << " is not a Horn clause database\n";
+      return false;
+    }
+    p += 2;
+    
+    ExprReader reader (m_efac, resolver);
+    p = reader.read (p, end);
+    if (p) p = load (reader, p, end);
+    
+    if (p != end)
+    {
+      errs () << "ERROR: " << file << " is not a valid Horn clause database\n";
+      return false;
+    }
+    return true;
+  }
+  
   raw_ostream& HornClauseDB::write (raw_ostream& o) const
   {
     std::ostringstream oss;
@@ -64,7 +357,7 @@ namespace seahorn
     for (auto &p : m_rels)
     { oss << p << "\n"; }
     oss << "Clauses:\n;";
-    for (auto &r : m_rules)
+    for (auto &r : getRules ())
     { oss << r.body () << "\n"; }
     oss << "Query:\n;";
     oss << m_query << "\n";
@@ -1,4 +1,5 @@
 #include "seahorn/HornClauseDBTransf.hh"
+#include "seahorn/ExprOrder.hh"
 #include "ufo/Expr.hpp"
 
 namespace seahorn
@@ -58,14 +59,383 @@ namespace seahorn
 
   void normalizeHornClauseHeads (HornClauseDB &db)
   {
-    vector<HornRule> worklist;
-    boost::copy (db.getRules (), std::back_inserter(worklist));
-
-    for (auto rule: worklist)
+    for (HornClauseDB::RuleId id : db.getRuleIds ())
     {
-      HornRule new_rule = replaceNonVarsInHead (rule);        
-      db.removeRule (rule);
+      HornRule new_rule = replaceNonVarsInHead (db.getRule (id));
+      if (new_rule == db.getRule (id)) continue;
+      db.removeRule (id);
       db.addRule (new_rule);
     }
   }
 }
+
+namespace seahorn
+{
+  namespace
+  {
+    /// A rule split into the relation applications of its body and
+    /// the remaining conjuncts. defs maps a constant to the conjunct
+    /// that defines it
+    struct SplitRule
+    {
+      HornRule rule;
+      ExprVector apps;
+      ExprVector phi;
+      std::map<Expr, unsigned> defs;
+      std::vector<bool> isDef;
+      
+      SplitRule (const HornRule &r) : rule (r) {}
+    };
+    
+    /// relevant argument positions of each relation
+    typedef std::map<Expr, std::vector<bool> > Relevance;
+    
+    void collectConsts (Expr e, ExprSet &out)
+    {filter (e, bind::IsConst (), std::inserter (out, out.begin ()));}
+    
+    void collectApps (const HornClauseDB &db, Expr e, ExprVector &out)
+    {
+      filter (e, [&db] (Expr u) 
+              {return bind::isFapp (u) && db.hasRelation (bind::fname (u));},
+              std::back_inserter (out));
+    }
+    
+    void conjuncts (Expr e, ExprVector &out)
+    {
+      if (isOpX<AND> (e))
+        for (auto it = e->args_begin (), end = e->args_end (); it != end; ++it)
+          conjuncts (*it, out);
+      else if (!isOpX<TRUE> (e))
+        out.push_back (e);
+    }
+    
+    void split (const HornClauseDB &db, SplitRule &sr, Relevance &rel)
+    {
+      ExprVector conj;
+      conjuncts (sr.rule.body (), conj);
+      for (Expr c : conj)
+      {
+        if (bind::isFapp (c) && db.hasRelation (bind::fname (c)))
+        {
+          sr.apps.push_back (c);
+          continue;
+        }
+        
+        // -- a relation under another operator keeps all its arguments
+        ExprVector nested;
+        collectApps (db, c, nested);
+        for (Expr app : nested) 
+          rel [bind::fname (app)].assign (bind::domainSz (bind::fname (app)), true);
+        
+        sr.phi.push_back (c);
+      }
+      
+      // -- definitions of constants that are defined once and not
+      // -- used by their own definition
+      std::set<Expr> dup;
+      for (unsigned i = 0; i < sr.phi.size (); ++i)
+      {
+        Expr c = sr.phi [i];
+        if (!(isOpX<EQ> (c) || isOpX<IFF> (c)) || !bind::IsConst () (c->left ()))
+          continue;
+        ExprSet rhs;
+        collectConsts (c->right (), rhs);
+        if (rhs.count (c->left ())) continue;
+        if (!sr.defs.insert (std::make_pair (c->left (), i)).second)
+          dup.insert (c->left ());
+      }
+      for (Expr u : dup) sr.defs.erase (u);
+      
+      sr.isDef.assign (sr.phi.size (), false);
+      for (auto &kv : sr.defs) sr.isDef [kv.second] = true;
+    }
+    
+    /// Computes the constants of a rule that influence the relevant
+    /// arguments of its head and of its body applications, and the
+    /// conjuncts that must be kept
+    void uses (SplitRule &sr, Relevance &rel, ExprSet &used, std::vector<bool> &needed)
+    {
+      Expr head = sr.rule.head ();
+      const std::vector<bool> &hr = rel [bind::fname (head)];
+      for (unsigned i = 0; i < hr.size (); ++i)
+        if (hr [i]) collectConsts (head->arg (i + 1), used);
+      
+      // -- a constant that is an argument of two body applications
+      // -- relates them. A definition of an argument constrains it,
+      // -- so the argument stays and so does the definition
+      ExprSet args;
+      for (Expr app : sr.apps)
+      {
+        const std::vector<bool> &r = rel [bind::fname (app)];
+        for (unsigned i = 0; i < r.size (); ++i)
+        {
+          Expr a = app->arg (i + 1);
+          if (r [i] || !bind::IsConst () (a)) collectConsts (a, used);
+          else if (sr.defs.count (a) || !args.insert (a).second) used.insert (a);
+        }
+      }
+      
+      needed.assign (sr.phi.size (), false);
+      for (unsigned i = 0; i < sr.phi.size (); ++i)
+      {
+        if (sr.isDef [i]) continue;
+        needed [i] = true;
+        collectConsts (sr.phi [i], used);
+      }
+      
+      ExprVector todo (used.begin (), used.end ());
+      while (!todo.empty ())
+      {
+        Expr u = todo.back ();
+        todo.pop_back ();
+        auto it = sr.defs.find (u);
+        if (it == sr.defs.end () || needed [it->second]) continue;
+        needed [it->second] = true;
+        ExprSet rhs;
+        collectConsts (sr.phi [it->second]->right (), rhs);
+        for (Expr v : rhs)
+          if (used.insert (v).second) todo.push_back (v);
+      }
+    }
+  }
+  
+  void sliceHornClauseDB (HornClauseDB &db, SliceMap &sliced)
+  {
+    if (!db.hasQuery ()) return;
+    
+    Relevance rel;
+    
+    // -- relations that can reach the query
+    ExprVector todo;
+    collectApps (db, db.getQuery (), todo);
+    for (Expr app : todo)
+      rel [bind::fname (app)].assign (bind::domainSz (bind::fname (app)), true);
+    for (Expr &app : todo) app = bind::fname (app);
+    
+    ExprSet reach (todo.begin (), todo.end ());
+    std::vector<SplitRule> rules;
+    while (!todo.empty ())
+    {
+      Expr reln = todo.back ();
+      todo.pop_back ();
+      rel [reln].resize (bind::domainSz (reln), false);
+      for (HornClauseDB::RuleId id : db.getHeadRules (reln))
+      {
+        rules.push_back (SplitRule (db.getRule (id)));
+        ExprVector apps;
+        collectApps (db, db.getRule (id).body (), apps);
+        for (Expr app : apps)
+          if (reach.insert (bind::fname (app)).second) 
+            todo.push_back (bind::fname (app));
+      }
+    }
+    
+    for (SplitRule &sr : rules) split (db, sr, rel);
+    
+    // -- propagate relevance from heads to bodies until a fixpoint
+    ExprSet used;
+    std::vector<bool> needed;
+    bool changed = true;
+    while (changed)
+    {
+      changed = false;
+      for (SplitRule &sr : rules)
+      {
+        used.clear ();
+        uses (sr, rel, used, needed);
+        for (Expr app : sr.apps)
+        {
+          std::vector<bool> &r = rel [bind::fname (app)];
+          for (unsigned i = 0; i < r.size (); ++i)
+          {
+            Expr a = app->arg (i + 1);
+            if (r [i] || (bind::IsConst () (a) && !used.count (a))) continue;
+            r [i] = true;
+            changed = true;
+          }
+        }
+      }
+    }
+    
+    // -- new relations
+    auto sliceApp = [&sliced] (Expr app)
+      {
+        auto it = sliced.find (bind::fname (app));
+        if (it == sliced.end ()) return app;
+        ExprVector args;
+        for (unsigned i : it->second.kept) args.push_back (app->arg (i + 1));
+        return bind::fapp (it->second.fdecl, args);
+      };
+    
+    ExprVector rels;
+    for (Expr reln : db.getRelations ())
+    {
+      if (!reach.count (reln)) continue;
+      const std::vector<bool> &r = rel [reln];
+      if (std::find (r.begin (), r.end (), false) == r.end ())
+      {
+        rels.push_back (reln);
+        continue;
+      }
+      
+      SlicedRelation &s = sliced [reln];
+      ExprVector ty;
+      for (unsigned i = 0; i < r.size (); ++i)
+        if (r [i]) 
+        {
+          s.kept.push_back (i);
+          ty.push_back (bind::domainTy (reln, i));
+        }
+      ty.push_back (bind::rangeTy (reln));
+      s.fdecl = bind::fdecl (bind::fname (reln), ty);
+      rels.push_back (s.fdecl);
+    }
+    
+    // -- new rules
+    std::vector<HornRule> newRules;
+    for (SplitRule &sr : rules)
+    {
+      used.clear ();
+      uses (sr, rel, used, needed);
+      
+      Expr head = sliceApp (sr.rule.head ());
+      ExprVector body;
+      for (Expr app : sr.apps) body.push_back (sliceApp (app));
+      for (unsigned i = 0; i < sr.phi.size (); ++i)
+        if (needed [i]) body.push_back (sr.phi [i]);
+      Expr b = mknary<AND> (mk<TRUE> (head->efac ()), body.begin (), body.end ());
+      
+      ExprSet consts;
+      collectConsts (head, consts);
+      collectConsts (b, consts);
+      ExprVector vars;
+      for (Expr v : sr.rule.vars ()) 
+        if (consts.count (v)) vars.push_back (v);
+      newRules.push_back (HornRule (vars, head, b));
+    }
+    
+    // -- constraints over the arguments that are kept
+    ExprVector preds, lemmas;
+    for (Expr reln : db.getRelations ())
+    {
+      if (!reach.count (reln) || !db.hasConstraints (reln)) continue;
+      
+      ExprVector args;
+      for (unsigned i = 0, sz = bind::domainSz (reln); i < sz; ++i)
+      {
+        Expr argName = mkTerm<std::string> 
+          ("arg_" + boost::lexical_cast<std::string> (i), reln->efac ());
+        args.push_back (bind::mkConst (argName, bind::domainTy (reln, i)));
+      }
+      Expr pred = bind::fapp (reln, args);
+      Expr spred = sliceApp (pred);
+      ExprSet kept (++spred->args_begin (), spred->args_end ());
+      
+      ExprVector conj, keep;
+      conjuncts (db.getConstraints (pred), conj);
+      for (Expr c : conj)
+      {
+        ExprSet consts;
+        collectConsts (c, consts);
+        if (std::includes (kept.begin (), kept.end (), consts.begin (), consts.end ()))
+          keep.push_back (c);
+      }
+      if (keep.empty ()) continue;
+      preds.push_back (spred);
+      lemmas.push_back (mknary<AND> (mk<TRUE> (reln->efac ()), keep.begin (), keep.end ()));
+    }
+    
+    Expr query = db.getQuery ();
+    db.reset ();
+    for (Expr reln : rels) db.registerRelation (reln);
+    for (HornRule &r : newRules) db.addRule (r);
+    db.addQuery (query);
+    for (unsigned i = 0; i < preds.size (); ++i) db.addConstraint (preds [i], lemmas [i]);
+  }
+}
+
+namespace seahorn
+{
+  namespace
+  {
+    /// Rebuilds expressions with the arguments of their commutative
+    /// operators sorted by ExprOrder
+    class Canonicalizer
+    {
+      ExprOrder m_order;
+      ExprMap m_cache;
+
+    public:
+      ExprOrder &order () { return m_order; }
+
+      Expr operator() (Expr e)
+      {
+        // -- post-order with an explicit stack. The flag is set once
+        // -- the children of the node have been pushed
+        std::vector<std::pair<Expr, bool> > stack;
+        stack.push_back (std::make_pair (e, false));
+        while (!stack.empty ())
+        {
+          Expr n = stack.back ().first;
+          if (m_cache.count (n))
+          {
+            stack.pop_back ();
+            continue;
+          }
+
+          if (!stack.back ().second)
+          {
+            stack.back ().second = true;
+            for (size_t i = n->arity (); i > 0; --i)
+              if (!m_cache.count (n->arg (i - 1)))
+                stack.push_back (std::make_pair (Expr (n->arg (i - 1)), false));
+            continue;
+          }
+
+          stack.pop_back ();
+          ExprVector args;
+          bool changed = false;
+          for (ENode::args_iterator b = n->args_begin (), end = n->args_end ();
+               b != end; ++b)
+          {
+            args.push_back (m_cache.at (*b));
+            changed = changed || args.back () != *b;
+          }
+          if (isOpX<AND> (n) || isOpX<OR> (n) || isOpX<PLUS> (n) ||
+              isOpX<MULT> (n))
+          {
+            ExprVector sorted (args);
+            m_order.sort (sorted);
+            changed = changed || sorted != args;
+            args.swap (sorted);
+          }
+          m_cache [n] = changed ?
+            n->efac ().mkNary (n->op (), args.begin (), args.end ()) : n;
+        }
+        return m_cache.at (e);
+      }
+    };
+  }
+
+  void canonicalizeHornClauseDB (HornClauseDB &db)
+  {
+    Canonicalizer canon;
+    HornClauseDB::RuleIdVector ids = db.getRuleIds ();
+    std::vector<HornRule> rules;
+    rules.reserve (ids.size ());
+    bool changed = false;
+    for (HornClauseDB::RuleId id : ids)
+    {
+      const HornRule &r = db.getRule (id);
+      ExprVector vars (r.vars ());
+      canon.order ().sort (vars);
+      rules.push_back (HornRule (vars, canon (r.head ()), canon (r.body ())));
+      changed = changed || !(rules.back () == r);
+    }
+    if (!changed) return;
+
+    // -- all rules are added again so that they keep their order
+    for (HornClauseDB::RuleId id : ids) db.removeRule (id);
+    for (const HornRule &r : rules) db.addRule (r);
+  }
+}
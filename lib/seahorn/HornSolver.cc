@@ -1,9 +1,11 @@
 #include "seahorn/HornSolver.hh"
 #include "seahorn/HornifyModule.hh"
 #include "seahorn/HornClauseDBTransf.hh"
+#include "seahorn/InvariantStore.hh"
 
 #include "llvm/IR/Function.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
 #include "ufo/Stats.hh"
 
 #include "boost/range/algorithm/reverse.hpp"
@@ -20,6 +22,18 @@ static llvm::cl::opt<bool>
 PrintAnswer ("horn-answer",
              cl::desc ("Print Horn answer"), cl::init (false));
 
+static llvm::cl::opt<bool>
+Slice ("horn-slice",
+       cl::desc ("Slice the Horn clauses w.r.t. the query before solving"),
+       cl::init (false));
+
+static llvm::cl::opt<std::string>
+InvStore ("horn-inv-store",
+          cl::desc ("Store of block invariants. Invariants of earlier runs "
+                    "that are still inductive are used as a starting point, "
+                    "and the store is updated when the property is proved"),
+          cl::init (""), cl::value_desc ("filename"));
+
 namespace seahorn
 {
   char HornSolver::ID = 0;
@@ -29,6 +43,10 @@ namespace seahorn
     Stats::sset ("Result", "UNKNOWN");
     
     HornifyModule &hm = getAnalysis<HornifyModule> ();
+    // -- invariants are reported and stored per block
+    if (hm.isLoaded () && (PrintAnswer || !InvStore.empty ()))
+      report_fatal_error ("-horn-answer and -horn-inv-store cannot be used "
+                          "with -horn-load-db");
 
     // Load the Horn clause database
     auto &db = hm.getHornClauseDB ();
@@ -48,6 +66,13 @@ namespace seahorn
 
     fp.set (params);
     
+    // -- warm start. Added before slicing, which projects them
+    if (!InvStore.empty ()) loadInvars (M);
+    
+    // -- slice here since z3 slicing does not preserve covers
+    m_sliced.clear ();
+    if (Slice) sliceHornClauseDB (db, m_sliced);
+    
     db.loadZFixedPoint (fp);
     
     Stats::resume ("Horn");
@@ -66,6 +91,8 @@ namespace seahorn
          if (m_result || !m_result) errs () << fp.getAnswer () << "\n";);
 
 
+    if (!InvStore.empty () && !m_result) saveInvars (M);
+    
     if (PrintAnswer && !m_result)
       printInvars (M);
     else if (PrintAnswer && m_result)
@@ -122,6 +149,28 @@ namespace seahorn
     for (auto &F : M) printInvars (F);
   }
 
+  Expr HornSolver::getInvariant (const BasicBlock &BB)
+  {
+    HornifyModule &hm = getAnalysis<HornifyModule> ();
+    if (!hm.hasBbPredicate (BB)) return Expr ();
+    
+    Expr bbPred = hm.bbPredicate (BB);
+    ExprVector live = hm.live (BB);
+    
+    // -- the predicate of a sliced relation has fewer arguments
+    auto it = m_sliced.find (bbPred);
+    if (it != m_sliced.end ())
+    {
+      ExprVector kept;
+      for (unsigned i : it->second.kept) kept.push_back (live [i]);
+      live.swap (kept);
+      bbPred = it->second.fdecl;
+    }
+    if (!hm.getHornClauseDB ().hasRelation (bbPred)) return Expr ();
+    
+    return m_fp->getCoverDelta (bind::fapp (bbPred, live));
+  }
+
   void HornSolver::printInvars (Function &F)
   {
     if (F.isDeclaration ()) return;
@@ -132,18 +181,12 @@ namespace seahorn
     // -- not used for now
     Expr summary = hm.summaryPredicate (F);
     
-    ZFixedPoint<EZ3> fp = *m_fp;
-
     for (auto &BB : F)
     {
-      if (!hm.hasBbPredicate (BB)) continue;
-
-      Expr bbPred = hm.bbPredicate (BB);
-
-      outs () << *bind::fname (bbPred) << ":";
-      const ExprVector &live = hm.live (BB);
-      Expr invars = fp.getCoverDelta (bind::fapp (bbPred, live));
+      Expr invars = getInvariant (BB);
+      if (!invars) continue;
 
+      outs () << *bind::fname (hm.bbPredicate (BB)) << ":";
       if (isOpX<AND> (invars))
       {
         outs () << "\n\t";
@@ -155,4 +198,84 @@ namespace seahorn
     }
   }
 
+  void HornSolver::loadInvars (Module &M)
+  {
+    HornifyModule &hm = getAnalysis<HornifyModule> ();
+    HornClauseDB &db = hm.getHornClauseDB ();
+    ExprValueResolver resolver (M);
+    InvariantStore store;
+    if (!store.load (InvStore, hm.getExprFactory (), resolver)) return;
+    
+    // -- candidates over the bound variables of the predicates
+    std::map<Expr, ExprVector> invs;
+    unsigned numCands = 0;
+    for (auto &F : M)
+      for (auto &BB : F)
+      {
+        if (!hm.hasBbPredicate (BB)) continue;
+        const ExprVector *lemmas = store.get (InvariantStore::key (BB));
+        if (!lemmas) continue;
+        Expr pred = hm.bbPredicate (BB);
+        if (!db.hasRelation (pred)) continue;
+        
+        const ExprVector &live = hm.live (BB);
+        ExprMap sub;
+        for (unsigned i = 0; i < live.size (); ++i)
+          sub [live [i]] = bind::bvar (i, bind::typeOf (live [i]));
+        
+        for (Expr l : *lemmas)
+        {
+          // -- a lemma over symbols that are no longer live is stale
+          ExprVector vars;
+          filter (l, bind::IsConst (), std::back_inserter (vars));
+          bool isLive = true;
+          for (Expr v : vars) isLive = isLive && sub.count (v);
+          if (!isLive) continue;
+          invs [pred].push_back (replace (l, sub));
+          ++numCands;
+        }
+      }
+    
+    validateInvariants (db, hm.getZContext (), invs);
+    
+    unsigned numInvs = 0;
+    for (auto &kv : invs)
+    {
+      if (kv.second.empty ()) continue;
+      ExprVector args;
+      for (unsigned i = 0, sz = bind::domainSz (kv.first); i < sz; ++i)
+        args.push_back (bind::mkConst (mkTerm<std::string>
+                                       ("arg_" + boost::lexical_cast<std::string> (i),
+                                        hm.getExprFactory ()),
+                                       bind::domainTy (kv.first, i)));
+      Expr app = bind::fapp (kv.first, args);
+      ExprMap sub;
+      for (unsigned i = 0; i < args.size (); ++i)
+        sub [bind::bvar (i, bind::typeOf (args [i]))] = args [i];
+      for (Expr l : kv.second) db.addConstraint (app, replace (l, sub));
+      numInvs += kv.second.size ();
+    }
+    
+    LOG ("horn-inv-store",
+         errs () << "HornSolver: " << numInvs << " of " << numCands
+                 << " stored invariants are still inductive\n";);
+  }
+
+  void HornSolver::saveInvars (Module &M)
+  {
+    InvariantStore store;
+    for (auto &F : M)
+      for (auto &BB : F)
+      {
+        Expr inv = getInvariant (BB);
+        if (!inv || isOpX<TRUE> (inv)) continue;
+        
+        ExprVector lemmas;
+        if (isOpX<AND> (inv)) lemmas.assign (inv->args_begin (), inv->args_end ());
+        else lemmas.push_back (inv);
+        store.set (InvariantStore::key (BB), lemmas);
+      }
+    store.save (InvStore);
+  }
+
 }
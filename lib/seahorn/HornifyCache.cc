@@ -0,0 +1,218 @@
+#include "seahorn/HornifyCache.hh"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/Function.h"
+#include "llvm/IR/GlobalVariable.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "ufo/ExprLlvm.hpp"
+
+#include <cstring>
+
+namespace seahorn
+{
+  using namespace llvm;
+
+  namespace
+  {
+    /// "SHFC" as a little-endian word
+    const uint32_t CACHE_MAGIC = 0x43464853;
+    const uint32_t CACHE_VERSION = 2;
+    const uint32_t NO_EXPR = 0xFFFFFFFF;
+  }
+
+  std::string HornifyCache::key (StringRef desc)
+  {
+    MD5 md5;
+    md5.update (desc);
+    MD5::MD5Result res;
+    md5.final (res);
+    SmallString<32> str;
+    MD5::stringifyResult (res, str);
+    return std::string (str.begin (), str.end ());
+  }
+
+  std::string HornifyCache::path (StringRef key) const
+  {
+    SmallString<128> p (m_dir);
+    sys::path::append (p, key + ".shfc");
+    return std::string (p.begin (), p.end ());
+  }
+
+  bool HornifyCache::save (StringRef key, const HornifyCacheEntry &entry) const
+  {
+    ExprFactory &efac = entry.db.getExprFactory ();
+    ExprWriter w;
+    std::vector<uint32_t> words;
+    entry.db.save (w, words);
+
+    words.push_back (entry.live.size ());
+    for (auto &kv : entry.live)
+    {
+      words.push_back (w.add (mkTerm<const BasicBlock*> (kv.first, efac)));
+      words.push_back (kv.second.size ());
+      for (auto &v : kv.second) words.push_back (w.add (v));
+    }
+
+    auto value = [&] (const Value *v)
+      { return v ? w.add (mkTerm<const Value*> (v, efac)) : NO_EXPR; };
+
+    const FunctionInfo &fi = entry.info;
+    words.push_back (entry.hasInfo);
+    if (entry.hasInfo)
+    {
+      words.push_back (w.add (fi.sumPred));
+      words.push_back (fi.regions.size ());
+      for (const Value *v : fi.regions) words.push_back (value (v));
+      words.push_back (fi.args.size ());
+      for (const Value *v : fi.args) words.push_back (value (v));
+      words.push_back (fi.globals.size ());
+      for (const Value *v : fi.globals) words.push_back (value (v));
+      words.push_back (value (fi.ret));
+    }
+
+    if (!w.ok ()) return false;
+
+    // -- the entry is written to a temporary file that is renamed, so
+    // -- that concurrent runs never read a partial entry
+    std::error_code ec = sys::fs::create_directories (m_dir);
+    SmallString<128> tmp;
+    int fd;
+    if (!ec) ec = sys::fs::createUniqueFile (path (key) + "-%%%%%%", fd, tmp);
+    if (ec)
+    {
+      errs () << "WARNING: Cannot write to the cache " << m_dir << ": "
+              << ec.message () << "\n";
+      return false;
+    }
+
+    {
+      raw_fd_ostream out (fd, true);
+      const uint32_t hdr [] = {CACHE_MAGIC, CACHE_VERSION};
+      out.write (reinterpret_cast<const char*> (hdr), sizeof (hdr));
+      w.write (out);
+      out.write (reinterpret_cast<const char*> (words.data ()),
+                 words.size () * sizeof (uint32_t));
+    }
+
+    if (sys::fs::rename (tmp.str (), path (key)))
+    {
+      sys::fs::remove (tmp.str ());
+      return false;
+    }
+    return true;
+  }
+
+  bool HornifyCache::load (StringRef key, const ExprValueResolver &resolver,
+                           HornifyCacheEntry &entry) const
+  {
+    ErrorOr<std::unique_ptr<MemoryBuffer> > buf =
+      MemoryBuffer::getFile (path (key), -1, false);
+    if (!buf) return false;
+
+    StringRef data = (*buf)->getBuffer ();
+    // -- the words are read in place unless the buffer is not aligned
+    std::vector<uint32_t> copy;
+    const uint32_t *p = reinterpret_cast<const uint32_t*> (data.data ());
+    if (reinterpret_cast<uintptr_t> (p) % alignof (uint32_t) != 0)
+    {
+      copy.resize (data.size () / sizeof (uint32_t));
+      std::memcpy (copy.data (), data.data (), copy.size () * sizeof (uint32_t));
+      p = copy.data ();
+    }
+    const uint32_t *end = p + data.size () / sizeof (uint32_t);
+
+    if (data.size () % sizeof (uint32_t) != 0 || end - p < 2 ||
+        p [0] != CACHE_MAGIC || p [1] != CACHE_VERSION)
+      return false;
+    p += 2;
+
+    ExprReader reader (entry.db.getExprFactory (), &resolver);
+    p = reader.read (p, end);
+    // -- an entry that refers to values that are not in the module is
+    // -- a miss, the encoding would mention constants that no longer exist
+    if (p && !reader.resolved ()) return false;
+    if (p) p = entry.db.load (reader, p, end);
+
+    auto word = [&] (uint32_t &w)
+      {
+        if (!p || p == end) return false;
+        w = *p++;
+        return true;
+      };
+    auto expr = [&] (Expr &e)
+      {
+        uint32_t idx;
+        if (!word (idx)) return false;
+        e = reader.get (idx);
+        return e != nullptr;
+      };
+    /// a value that resolves in the current module, or NULL
+    auto value = [&] (const Value *&v)
+      {
+        uint32_t idx;
+        if (!word (idx)) return false;
+        v = nullptr;
+        if (idx == NO_EXPR) return true;
+        Expr e = reader.get (idx);
+        if (!e || !isOpX<VALUE> (e)) return false;
+        v = getTerm<const Value*> (e);
+        return true;
+      };
+
+    bool ok = true;
+    uint32_t n = 0;
+    ok = ok && word (n);
+    entry.live.clear ();
+    for (uint32_t i = 0; ok && i < n; ++i)
+    {
+      Expr bb;
+      uint32_t sz = 0;
+      ok = expr (bb) && isOpX<BB> (bb) && word (sz);
+      ExprVector live;
+      for (uint32_t j = 0; ok && j < sz; ++j)
+      {
+        Expr v;
+        ok = expr (v);
+        live.push_back (v);
+      }
+      if (ok) entry.live.push_back (std::make_pair (getTerm<const BasicBlock*> (bb),
+                                                    live));
+    }
+
+    uint32_t hasInfo = 0;
+    ok = ok && word (hasInfo);
+    entry.hasInfo = hasInfo;
+    entry.info = FunctionInfo ();
+    if (ok && hasInfo)
+    {
+      FunctionInfo &fi = entry.info;
+      const Value *v;
+      ok = expr (fi.sumPred) && word (n);
+      for (uint32_t i = 0; ok && i < n; ++i)
+      {
+        ok = value (v) && v;
+        fi.regions.push_back (v);
+      }
+      ok = ok && word (n);
+      for (uint32_t i = 0; ok && i < n; ++i)
+      {
+        ok = value (v) && v && isa<Argument> (v);
+        if (ok) fi.args.push_back (cast<Argument> (v));
+      }
+      ok = ok && word (n);
+      for (uint32_t i = 0; ok && i < n; ++i)
+      {
+        ok = value (v) && v && isa<GlobalVariable> (v);
+        if (ok) fi.globals.push_back (cast<GlobalVariable> (v));
+      }
+      ok = ok && value (fi.ret);
+    }
+
+    return ok && p == end;
+  }
+}
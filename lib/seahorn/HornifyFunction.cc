@@ -2,6 +2,20 @@
 #include "seahorn/LiveSymbols.hh"
 #include "seahorn/Support/CFG.hh"
 #include "seahorn/Support/ExprSeahorn.hh"
+#include "ufo/ExprNorm.hpp"
+
+#include "llvm/Support/CommandLine.h"
+
+#include <boost/unordered_map.hpp>
+
+#include <deque>
+
+static llvm::cl::opt<bool>
+SliceSide ("horn-slice-side",
+           llvm::cl::desc ("Remove definitions of symbols that do not affect "
+                           "the live symbols or the branch condition of an edge"),
+           llvm::cl::init (false),
+           llvm::cl::Hidden);
 
 namespace seahorn
 {
@@ -15,6 +29,70 @@ namespace seahorn
     return NULL;
   }
   
+  /// true if e is a definition of a constant, lhs = rhs
+  static bool isDefinition (Expr e)
+  {
+    return (isOpX<EQ> (e) || isOpX<IFF> (e)) && bind::IsConst () (e->left ());
+  }
+  
+  /// Cone-of-influence slicing of the side condition of an edge.
+  ///
+  /// Removes the definitions of constants that neither are in roots
+  /// nor are used by a constraint that is kept. All other constraints
+  /// (branch conditions, assumptions, summaries) are kept. The side
+  /// condition is in SSA form, so each removed definition is
+  /// satisfiable by its own fresh constant and removing it does not
+  /// change the projection of the side condition on roots. A constant
+  /// that is defined more than once is treated as used.
+  static void sliceSide (ExprVector &side, const ExprSet &roots)
+  {
+    const unsigned NONE = side.size ();
+    // -- the unique definition of each constant, or NONE
+    boost::unordered_map<Expr,unsigned> def;
+    std::vector<bool> keep (side.size (), true);
+    for (unsigned i = 0; i < side.size (); ++i)
+    {
+      if (!isDefinition (side [i])) continue;
+      auto res = def.insert (std::make_pair (side [i]->left (), i));
+      if (res.second) keep [i] = false;
+      else if (res.first->second != NONE)
+      {
+        keep [res.first->second] = true;
+        res.first->second = NONE;
+      }
+    }
+    
+    ExprSet coi (roots);
+    ExprVector todo (roots.begin (), roots.end ());
+    auto use = [&] (Expr e)
+      {
+        ExprVector consts;
+        filter (e, bind::IsConst (), std::back_inserter (consts));
+        for (const Expr &c : consts)
+          if (coi.insert (c).second) todo.push_back (c);
+      };
+    
+    for (unsigned i = 0; i < side.size (); ++i)
+      if (keep [i]) use (side [i]);
+    
+    while (!todo.empty ())
+    {
+      Expr c = todo.back ();
+      todo.pop_back ();
+      auto it = def.find (c);
+      if (it == def.end () || it->second == NONE || keep [it->second]) continue;
+      keep [it->second] = true;
+      use (side [it->second]);
+    }
+    
+    unsigned j = 0;
+    for (unsigned i = 0; i < side.size (); ++i)
+      if (keep [i]) side [j++] = side [i];
+    side.resize (j);
+  }
+  
+  bool HornifyFunction::slicesSide () {return SliceSide;}
+
   void HornifyFunction::extractFunctionInfo (const BasicBlock &BB)
   {
     const ReturnInst *ret = dyn_cast<const ReturnInst> (BB.getTerminator ());
@@ -62,7 +140,8 @@ namespace seahorn
       Expr v = m_sem.symb (arg);
       if (!v) continue;
       
-      if (! std::binary_search (live.begin (), live.end (), v) ) continue;
+      // -- live is not sorted if it was set from the cache
+      if (std::find (live.begin (), live.end (), v) == live.end ()) continue;
       
       fi.args.push_back (&arg);
       sorts.push_back (bind::typeOf (v));
@@ -134,6 +213,70 @@ namespace seahorn
   }
   
   
+  void HornifyFunction::addExitRules (const Function &F, const BasicBlock &exit)
+  {
+    const LiveSymbols &ls = m_parent.getLiveSybols (F);
+    ExprSet allVars;
+    SymStore s (m_efac);
+    
+    // Add error flag exit rules
+    // bb (err, V) & err -> bb_exit (err , V)
+    for (auto &BB : F)
+    {
+      if (&BB == &exit || !hasPredicate (BB)) continue;
+      
+      // XXX Can optimize. Only need the rules for BBs that trip the
+      // error flag (directly or indirectly)
+      s.reset ();
+      allVars.clear ();
+      const ExprVector &live = ls.live (&BB);
+      for (const Expr &v : live) allVars.insert (s.read (v));
+      Expr pre = bind::fapp (m_parent.bbPredicate (BB), s.evalAll (live));
+      pre = boolop::land (pre, s.read (m_sem.errorFlag (BB)));
+      
+      for (const Expr &v : ls.live (&exit)) allVars.insert (s.read (v));
+      Expr post = 
+        bind::fapp (m_parent.bbPredicate (exit), s.evalAll (ls.live (&exit)));
+      m_db.addRule (allVars, boolop::limp (pre, post));
+    }
+    
+    s.reset ();
+    allVars.clear ();
+    
+    if (F.getName ().equals ("main") && ls.live(&exit).size () == 1)
+      m_db.addQuery (bind::fapp (m_parent.bbPredicate(exit), mk<TRUE> (m_efac)));
+    else if (F.getName ().equals ("main") && ls.live (&exit).size () == 0)
+      m_db.addQuery (bind::fapp (m_parent.bbPredicate(exit)));
+    else if (m_interproc)
+    {
+      // the summary rule
+      // exit(live_at_exit) & !error.flag ->
+      //                  summary(true, false, false, regions, arguments, globals, return)
+      
+      const ExprVector &live = ls.live (&exit);
+      for (const Expr &v : live) allVars.insert (s.read (v));
+      Expr pre = bind::fapp (m_parent.bbPredicate (exit), s.evalAll (live));
+      pre = boolop::land (pre, boolop::lneg (s.read (m_sem.errorFlag (exit))));
+      
+      Expr falseE = mk<FALSE> (m_efac);
+      ExprVector postArgs {mk<TRUE> (m_efac), falseE, falseE};
+      const FunctionInfo &fi = m_sem.getFunctionInfo (F);
+      fi.evalArgs (m_sem, s, std::back_inserter (postArgs));
+      std::copy_if (postArgs.begin () + 3, postArgs.end (), 
+                    std::inserter (allVars, allVars.begin ()),
+                    bind::IsConst());
+      Expr post = bind::fapp (fi.sumPred, postArgs);
+      m_db.addRule (allVars, boolop::limp (pre, post));
+      
+      // the error rule
+      // bb_exit (true, V) -> S(true, false, true, V)
+      pre = boolop::land (pre->arg (0), s.read (m_sem.errorFlag (exit)));
+      postArgs [2] = mk<TRUE> (m_efac);
+      post = bind::fapp (fi.sumPred, postArgs);
+      m_db.addRule (allVars, boolop::limp (pre, post));
+    }
+  }
+  
   void SmallHornifyFunction::runOnFunction (Function &F)
   {
 
@@ -166,7 +309,7 @@ namespace seahorn
     ExprSet allVars;
     SymStore s(m_efac);
     for (const Expr& v : ls.live (&F.getEntryBlock ())) allVars.insert (s.read (v));
-    Expr rule = s.eval (bind::fapp (m_parent.bbPredicate (entry), ls.live (&entry)));
+    Expr rule = bind::fapp (m_parent.bbPredicate (entry), s.evalAll (ls.live (&entry)));
     rule = boolop::limp (boolop::lneg (s.read (m_sem.errorFlag (entry))), rule);
     m_db.addRule (allVars, rule);
     allVars.clear ();
@@ -184,18 +327,27 @@ namespace seahorn
         const ExprVector &live = ls.live (bb);
         for (const Expr &v : live) allVars.insert (s.read (v));
         
-        Expr pre = s.eval (bind::fapp (m_parent.bbPredicate (BB), live));
+        Expr pre = bind::fapp (m_parent.bbPredicate (BB), s.evalAll (live));
         side.push_back (boolop::lneg ((s.read (m_sem.errorFlag (BB)))));
         m_sem.execEdg (s, BB, *dst, side);
+        
+        if (SliceSide)
+        {
+          // -- allVars holds the values of the symbols live at bb
+          ExprSet roots (allVars);
+          for (const Expr &v : ls.live (dst)) roots.insert (s.read (v));
+          roots.insert (s.read (m_sem.errorFlag (*dst)));
+          sliceSide (side, roots);
+        }
 
-        Expr tau = mknary<AND> (mk<TRUE> (m_efac), side);
+        Expr tau = norm::mknary<AND> (mk<TRUE> (m_efac), side);
 
         expr::filter (tau, bind::IsConst(), 
                       std::inserter (allVars, allVars.begin ()));
         for (const Expr &v : ls.live (dst)) allVars.insert (s.read (v));
 
         Expr post;
-        post = s.eval (bind::fapp (m_parent.bbPredicate (*dst), ls.live (dst)));
+        post = bind::fapp (m_parent.bbPredicate (*dst), s.evalAll (ls.live (dst)));
         
         LOG("seahorn", errs() << "Adding rule : " 
             << *mk<IMPL> (boolop::land (pre, tau), post) << "\n";);
@@ -203,68 +355,292 @@ namespace seahorn
       }
     }
 
-    allVars.clear ();
-    side.clear ();
-    s.reset ();
+    addExitRules (F, *exit);
+  }
+
+  bool MediumHornifyFunction::isAnchor (const BasicBlock &bb)
+  {
+    const BasicBlock *pred = bb.getSinglePredecessor ();
+    return (!pred && !m_merged.count (&bb)) || pred == &bb ||
+      &bb == &bb.getParent ()->getEntryBlock () || &bb == m_exit;
+  }
+  
+  void MediumHornifyFunction::findDiamonds (const Function &F)
+  {
+    m_joins.clear ();
+    m_merged.clear ();
+    const BasicBlock *entry = &F.getEntryBlock ();
+    
+    SmallPtrSet<const BasicBlock*, 4> arms;
+    for (const BasicBlock &head : F)
+    {
+      arms.clear ();
+      const BasicBlock *join = NULL;
+      bool ok = true;
+      for (const BasicBlock *b : succs (head))
+      {
+        // -- the arms start at distinct successors
+        if (!arms.insert (b).second) { ok = false; break; }
+        
+        // -- follow the chain of the arm. Its blocks have a single
+        // -- predecessor, so the walk cannot cycle
+        const BasicBlock *cur = b;
+        while (ok && cur->getSinglePredecessor ())
+        {
+          const TerminatorInst *term = cur->getTerminator ();
+          ok = cur != entry && cur != m_exit && cur != &head &&
+            term->getNumSuccessors () == 1;
+          if (ok) cur = term->getSuccessor (0);
+        }
+        ok = ok && (!join || join == cur);
+        if (!ok) break;
+        join = cur;
+      }
+      
+      // -- the join is entered only from the arms, and the paths
+      // -- continue after it
+      ok = ok && arms.size () > 1 && join != &head && join != entry &&
+        join != m_exit && !m_merged.count (join) &&
+        succ_begin (join) != succ_end (join) &&
+        (unsigned) std::distance (pred_begin (join), pred_end (join)) == arms.size ();
+      if (!ok) continue;
+      
+      m_joins [&head] = join;
+      m_merged.insert (join);
+    }
+  }
+  
+  void MediumHornifyFunction::addPathRule (Expr pre, ExprVector &side, Expr post)
+  {
+    if (SliceSide)
+    {
+      ExprSet roots;
+      expr::filter (pre, bind::IsConst (), std::inserter (roots, roots.begin ()));
+      expr::filter (post, bind::IsConst (), std::inserter (roots, roots.begin ()));
+      sliceSide (side, roots);
+    }
     
+    Expr tau = norm::mknary<AND> (mk<TRUE> (m_efac), side);
+    Expr rule = boolop::limp (boolop::land (pre, tau), post);
     
-    // Add error flag exit rules
-    // bb (err, V) & err -> bb_exit (err , V)
-    assert(exit);
-
-    for (auto &BB : F)
+    ExprSet allVars;
+    expr::filter (rule, bind::IsConst (), 
+                  std::inserter (allVars, allVars.begin ()));
+    LOG("seahorn", errs() << "Adding rule : " << *rule << "\n";);
+    m_db.addRule (allVars, rule);
+  }
+  
+  namespace
+  {
+    /// an edge that a path of MediumHornifyFunction::fuse () has yet
+    /// to take, with a copy of the path up to its source
+    struct FuseBranch
     {
-      if (&BB == exit) continue;
+      const BasicBlock *src;
+      const BasicBlock *dst;
+      SymStore s;
+      ExprVector side;
       
-      // XXX Can optimize. Only need the rules for BBs that trip the
-      // error flag (directly or indirectly)
-      s.reset ();
-      allVars.clear ();
-      const ExprVector &live = ls.live (&BB);
-      for (const Expr &v : live) allVars.insert (s.read (v));
-      Expr pre = s.eval (bind::fapp (m_parent.bbPredicate (BB), live));
-      pre = boolop::land (pre, s.read (m_sem.errorFlag (BB)));
+      FuseBranch (const BasicBlock *from, const BasicBlock *to, 
+                  const SymStore &store, const ExprVector &sd) :
+        src (from), dst (to), s (store), side (sd) {}
+    };
+  }
+  
+  void MediumHornifyFunction::mergeDiamond (const BasicBlock &head,
+                                            const BasicBlock &join,
+                                            Expr pre, Expr err, 
+                                            SymStore &s, ExprVector &side)
+  {
+    const LiveSymbols &ls = m_parent.getLiveSybols (*head.getParent ());
+    Expr trueE = mk<TRUE> (m_efac);
+    
+    // -- the body of head is common to all arms
+    m_sem.exec (s, head, side, trueE);
+    
+    // -- the values that join reads, and the error flag. They are
+    // -- read before the arms, so that the arms that do not write a
+    // -- value agree on it
+    ExprVector keys (ls.live (&join));
+    keys.push_back (m_sem.errorFlag (join));
+    for (const Expr &k : keys) s.read (k);
+    
+    // -- the stores of the arms share the parent of s, so that the
+    // -- constants they create are distinct
+    std::vector<SymStore> stores;
+    std::vector<ExprVector> asides;
+    for (const BasicBlock *b : succs (head))
+    {
+      stores.push_back (s);
+      asides.push_back (ExprVector ());
+      SymStore &as = stores.back ();
+      ExprVector &aside = asides.back ();
       
-      for (const Expr &v : ls.live (exit)) allVars.insert (s.read (v));
-      Expr post = 
-        s.eval (bind::fapp (m_parent.bbPredicate (*exit), ls.live (exit)));
-      m_db.addRule (allVars, boolop::limp (pre, post));
+      m_sem.execBr (as, head, *b, aside, trueE);
+      m_sem.execPhi (as, *b, head, aside, trueE);
+      const BasicBlock *cur = b;
+      while (cur != &join)
+      {
+        // -- as in fuse (), the path ends at the exit if the error
+        // -- flag is set on the way to cur
+        Expr curErr = as.read (m_sem.errorFlag (*cur));
+        if (curErr != err && !isOpX<FALSE> (curErr))
+        {
+          ExprVector eside (side);
+          eside.insert (eside.end (), aside.begin (), aside.end ());
+          eside.push_back (curErr);
+          Expr post = bind::fapp (m_parent.bbPredicate (*m_exit), 
+                                  as.evalAll (ls.live (m_exit)));
+          addPathRule (pre, eside, post);
+        }
+        aside.push_back (boolop::lneg (curErr));
+        
+        const BasicBlock *next = cur->getTerminator ()->getSuccessor (0);
+        m_sem.execEdg (as, *cur, *next, aside);
+        cur = next;
+      }
     }
     
-    if (F.getName ().equals ("main") && ls.live(exit).size () == 1)
-      m_db.addQuery (bind::fapp (m_parent.bbPredicate(*exit), mk<TRUE> (m_efac)));
-    else if (F.getName ().equals ("main") && ls.live (exit).size () == 0)
-      m_db.addQuery (bind::fapp (m_parent.bbPredicate(*exit)));
-    else if (m_interproc)
+    for (const Expr &k : keys)
     {
-      // the summary rule
-      // exit(live_at_exit) & !error.flag ->
-      //                  summary(true, false, false, regions, arguments, globals, return)
+      Expr v = stores [0].read (k);
+      bool same = true;
+      for (unsigned i = 1; same && i < stores.size (); ++i)
+        same = stores [i].read (k) == v;
+      if (same)
+      {
+        s.write (k, v);
+        continue;
+      }
       
-      const ExprVector &live = ls.live (exit);
-      for (const Expr &v : live) allVars.insert (s.read (v));
-      Expr pre = s.eval (bind::fapp (m_parent.bbPredicate (*exit), live));
-      pre = boolop::land (pre, boolop::lneg (s.read (m_sem.errorFlag (*exit))));
+      v = s.havoc (k);
+      for (unsigned i = 0; i < stores.size (); ++i)
+        asides [i].push_back (mk<EQ> (v, stores [i].read (k)));
+    }
+    
+    ExprVector arms;
+    for (ExprVector &aside : asides)
+      arms.push_back (norm::mknary<AND> (trueE, aside));
+    side.push_back (norm::mknary<OR> (mk<FALSE> (m_efac), arms));
+  }
+  
+  void MediumHornifyFunction::fuse (const BasicBlock &bb, Expr pre, Expr err,
+                                    SymStore &s, ExprVector &side)
+  {
+    const LiveSymbols &ls = m_parent.getLiveSybols (*bb.getParent ());
+    
+    // -- the current path is extended in place along the first
+    // -- successor of a block. The other successors get a copy of it,
+    // -- which is taken once the current path reaches an anchor
+    std::deque<FuseBranch> branches;
+    SmallVector<const BasicBlock*, 4> dsts;
+    const BasicBlock *src = &bb;
+    const BasicBlock *dst = NULL;
+    while (true)
+    {
+      dsts.clear ();
+      auto diamond = src ? m_joins.find (src) : m_joins.end ();
+      if (diamond != m_joins.end ())
+      {
+        // -- the arms of a non-branching diamond are taken at once
+        dst = diamond->second;
+        mergeDiamond (*src, *dst, pre, err, s, side);
+      }
+      else
+      {
+        if (src) dsts.append (succ_begin (src), succ_end (src));
+        if (!dsts.empty ())
+        {
+          dst = dsts [0];
+          // -- in reverse, so that paths are taken in depth-first order
+          for (unsigned i = dsts.size () - 1; i > 0; --i)
+            branches.emplace_back (src, dsts [i], s, side);
+        }
+        else
+        {
+          if (branches.empty ()) return;
+          FuseBranch &b = branches.back ();
+          src = b.src;
+          dst = b.dst;
+          s.swap (b.s);
+          side.swap (b.side);
+          branches.pop_back ();
+        }
+        m_sem.execEdg (s, *src, *dst, side);
+      }
       
-      Expr falseE = mk<FALSE> (m_efac);
-      ExprVector postArgs {mk<TRUE> (m_efac), falseE, falseE};
-      const FunctionInfo &fi = m_sem.getFunctionInfo (F);
-      fi.evalArgs (m_sem, s, std::back_inserter (postArgs));
-      std::copy_if (postArgs.begin () + 3, postArgs.end (), 
-                    std::inserter (allVars, allVars.begin ()),
-                    bind::IsConst());
-      Expr post = bind::fapp (fi.sumPred, postArgs);
-      m_db.addRule (allVars, boolop::limp (pre, post));
+      if (isAnchor (*dst))
+      {
+        Expr post = bind::fapp (m_parent.bbPredicate (*dst), 
+                                s.evalAll (ls.live (dst)));
+        addPathRule (pre, side, post);
+        src = NULL;
+        continue;
+      }
       
-      // the error rule
-      // bb_exit (true, V) -> S(true, false, true, V)
-      pre = boolop::land (pre->arg (0), s.read (m_sem.errorFlag (*exit)));
-      postArgs [2] = mk<TRUE> (m_efac);
-      post = bind::fapp (fi.sumPred, postArgs);
-      m_db.addRule (allVars, boolop::limp (pre, post));
+      // -- the path ends at the exit if the error flag is set on the
+      // -- way to dst. The flag is false at the anchor
+      Expr dstErr = s.read (m_sem.errorFlag (*dst));
+      if (dstErr != err && !isOpX<FALSE> (dstErr))
+      {
+        ExprVector eside (side);
+        eside.push_back (dstErr);
+        Expr post = bind::fapp (m_parent.bbPredicate (*m_exit), 
+                                s.evalAll (ls.live (m_exit)));
+        addPathRule (pre, eside, post);
+      }
+      
+      side.push_back (boolop::lneg (dstErr));
+      src = dst;
+    }
+  }
+  
+  void MediumHornifyFunction::runOnFunction (Function &F)
+  {
+    const BasicBlock *exit = findExitBlock (F);
+    m_exit = exit;
+    if (!exit)
+    {
+      errs () << "The exit block of " << F.getName () << " is unreachable.\n";
+      return;
+    }
+    findDiamonds (F);
+
+    const LiveSymbols &ls = m_parent.getLiveSybols (F);
+
+    for (auto &BB : F)
+    {
+      if (!isAnchor (BB)) continue;
+      m_db.registerRelation (m_parent.bbPredicate (BB));
+      if (m_interproc) extractFunctionInfo (BB);
+    }
+
+    const BasicBlock &entry = F.getEntryBlock ();
+    ExprSet allVars;
+    SymStore s (m_efac);
+    for (const Expr& v : ls.live (&entry)) allVars.insert (s.read (v));
+    Expr rule = bind::fapp (m_parent.bbPredicate (entry), s.evalAll (ls.live (&entry)));
+    rule = boolop::limp (boolop::lneg (s.read (m_sem.errorFlag (entry))), rule);
+    m_db.addRule (allVars, rule);
+    allVars.clear ();
+    
+    ExprVector side;
+    for (auto &BB : F)
+    {
+      if (!isAnchor (BB)) continue;
+      s.reset ();
+      side.clear ();
+      
+      // -- the arguments of pre are the values that the paths read
+      const ExprVector &live = ls.live (&BB);
+      for (const Expr &v : live) s.read (v);
+      Expr err = s.read (m_sem.errorFlag (BB));
+      Expr pre = bind::fapp (m_parent.bbPredicate (BB), s.evalAll (live));
+      side.push_back (boolop::lneg (err));
+      fuse (BB, pre, err, s, side);
     }
-    else if (!exit & m_interproc) assert (0);
     
+    addExitRules (F, *exit);
   }
 
   void LargeHornifyFunction::runOnFunction (Function &F)
@@ -303,7 +679,9 @@ namespace seahorn
     m_db.addRule (allVars, rule);
     allVars.clear ();
     
-    UfoLargeSymExec lsem (m_sem);
+    boost::scoped_ptr<LargeStepSymExec> lsem;
+    if (m_merge) lsem.reset (new UfoMergeSymExec (m_sem));
+    else lsem.reset (new UfoLargeSymExec (m_sem));
     
     for (const CutPoint &cp : cpg)
       {
@@ -322,8 +700,8 @@ namespace seahorn
           
           ExprVector side;
           side.push_back (boolop::lneg ((s.read (m_sem.errorFlag (cp.bb ())))));
-          lsem.execCpEdg (s, *edge, side);
-          Expr tau = mknary<AND> (mk<TRUE> (m_efac), side);
+          lsem->execCpEdg (s, *edge, side);
+          Expr tau = norm::mknary<AND> (mk<TRUE> (m_efac), side);
           expr::filter (tau, bind::IsConst(), 
                         std::inserter (allVars, allVars.begin ()));
 
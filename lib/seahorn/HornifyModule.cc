@@ -10,8 +10,12 @@
 #include "llvm/IR/CFG.h"
 #include "llvm/Analysis/CFG.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ErrorHandling.h"
 #include "llvm/Analysis/CallGraph.h"
 #include "llvm/ADT/SCCIterator.h"
+#include "llvm/IR/TypeFinder.h"
+#include "llvm/IR/CallSite.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "seahorn/Support/BoostLlvmGraphTraits.hh"
 
 #include "boost/range.hpp"
@@ -29,6 +33,11 @@
 
 #include "seahorn/HornifyFunction.hh"
 #include "seahorn/FlatHornifyFunction.hh"
+#include "seahorn/ExprSerialize.hh"
+#include "seahorn/HornClauseDBTransf.hh"
+
+#include <thread>
+#include <atomic>
 
 using namespace llvm;
 using namespace seahorn;
@@ -44,14 +53,19 @@ TL("horn-sem-lvl",
    cl::init (seahorn::REG));
 
 
-namespace hm_detail {enum Step {SMALL_STEP, LARGE_STEP, CLP_SMALL_STEP, FLAT_LARGE_STEP};}
+namespace hm_detail {enum Step {SMALL_STEP, LARGE_STEP, CLP_SMALL_STEP, FLAT_LARGE_STEP,
+                            MERGE_LARGE_STEP, MEDIUM_STEP};}
 
 static llvm::cl::opt<enum hm_detail::Step>
 Step("horn-step",
      llvm::cl::desc ("Step to use for the encoding"),
      cl::values (clEnumValN (hm_detail::SMALL_STEP, "small", "Small Step"),
+                 clEnumValN (hm_detail::MEDIUM_STEP, "medium", 
+                             "Small Step with fused blocks"),
                  clEnumValN (hm_detail::LARGE_STEP, "large", "Large Step"),
                  clEnumValN (hm_detail::FLAT_LARGE_STEP, "flarge", "Flat Large Step"),
+                 clEnumValN (hm_detail::MERGE_LARGE_STEP, "mlarge",
+                             "Large Step with paths merged at join points"),
                  clEnumValN (hm_detail::CLP_SMALL_STEP, "clpsmall", "CLP Small Step"),
                  clEnumValEnd),
      cl::init (hm_detail::SMALL_STEP));
@@ -61,13 +75,45 @@ InterProc("horn-inter-proc",
           llvm::cl::desc ("Use inter-procedural encoding"),
           cl::init (false));
 
+static llvm::cl::opt<std::string>
+SaveDb ("horn-save-db",
+        llvm::cl::desc ("Save the Horn clauses in binary form to the given file"),
+        cl::init (""), cl::value_desc ("filename"));
+
+static llvm::cl::opt<std::string>
+LoadDb ("horn-load-db",
+        llvm::cl::desc ("Load the Horn clauses from a file written by "
+                        "-horn-save-db instead of encoding the module. "
+                        "Blocks have no predicates then, so -horn-answer, "
+                        "-horn-inv-store and -horn-cex are rejected"),
+        cl::init (""), cl::value_desc ("filename"));
+
+static llvm::cl::opt<std::string>
+CacheDir ("horn-cache-dir",
+          llvm::cl::desc ("Directory of a cache of the encoding of functions. "
+                          "Functions whose encoding is in the cache are not "
+                          "encoded again"),
+          cl::init (""), cl::value_desc ("dir"));
+
+static llvm::cl::opt<unsigned>
+Threads ("horn-threads",
+         llvm::cl::desc ("Number of threads used to encode the functions "
+                         "of the call graph (small and medium step only)"),
+         cl::init (1));
+
+/// Version of the encoding in the keys of -horn-cache-dir. Bump it
+/// whenever the clauses of a function change for the same input, so
+/// that the entries of an older build are not replayed.
+static const unsigned CacheFormat = 3;
+
 namespace seahorn
 {
   char HornifyModule::ID = 0;
+  thread_local HornifyModule::Context *HornifyModule::s_ctx = nullptr;
 
   HornifyModule::HornifyModule () :
     ModulePass (ID), m_zctx (m_efac),  m_db (m_efac),
-    m_td(0)
+    m_td(0), m_loaded (false)
   {
   }
 
@@ -83,6 +129,16 @@ namespace seahorn
     else
       m_sem.reset (new UfoSmallSymExec (m_efac, *this, TL));
 
+    if (!LoadDb.empty ())
+    {
+      // -- blocks and values are mapped back to those of M
+      ExprValueResolver resolver (M);
+      if (!m_db.load (LoadDb, &resolver))
+        report_fatal_error ("Cannot load Horn clauses from " + LoadDb);
+      m_loaded = true;
+      return false;
+    }
+
     // create FunctionInfo for verifier.error() function
     if (Function* errorFn = M.getFunction ("verifier.error"))
     {
@@ -124,19 +180,35 @@ namespace seahorn
     }
 
 
-    CallGraph &CG = getAnalysis<CallGraphWrapperPass> ().getCallGraph ();
-    for (auto it = scc_begin (&CG); !it.isAtEnd (); ++it)
+    if (!CacheDir.empty ())
     {
-      const std::vector<CallGraphNode*> &scc = *it;
-      CallGraphNode *cgn = scc.front ();
-      Function *f = cgn->getFunction ();
-      if (it.hasLoop () || scc.size () > 1)
-        errs () << "WARNING RECURSION at " << (f ? f->getName () : "nil") << "\n";
-      // assert (!it.hasLoop () && "Recursion not yet supported");
-      // assert (scc.size () == 1 && "Recursion not supported");
-      if (f) Changed = (runOnFunction (*f) || Changed);
+      m_cache.reset (new HornifyCache (CacheDir));
+      m_resolver.reset (new ExprValueResolver (M));
     }
 
+    CallGraph &CG = getAnalysis<CallGraphWrapperPass> ().getCallGraph ();
+    // -- large steps query the cut-point graph of each function on
+    // -- demand, which is not thread-safe
+    bool parallel = Threads > 1 &&
+      (Step == hm_detail::SMALL_STEP || Step == hm_detail::MEDIUM_STEP ||
+       Step == hm_detail::CLP_SMALL_STEP);
+    if (Threads > 1 && !parallel)
+      errs () << "WARNING: -horn-threads is ignored by large step encodings\n";
+    
+    if (parallel) Changed = runParallel (M, CG);
+    else
+      for (auto it = scc_begin (&CG); !it.isAtEnd (); ++it)
+      {
+        const std::vector<CallGraphNode*> &scc = *it;
+        CallGraphNode *cgn = scc.front ();
+        Function *f = cgn->getFunction ();
+        if (it.hasLoop () || scc.size () > 1)
+          errs () << "WARNING RECURSION at " << (f ? f->getName () : "nil") << "\n";
+        // assert (!it.hasLoop () && "Recursion not yet supported");
+        // assert (scc.size () == 1 && "Recursion not supported");
+        if (f) Changed = (runOnFunction (*f) || Changed);
+      }
+
 
     /**
        TODO:
@@ -186,6 +258,13 @@ namespace seahorn
             c. query is whether main gets to its return location (same as UFO)
 
     */
+    // -- the order of the arguments of conjunctions and of the
+    // -- variables of rules follows the ids of their nodes, which
+    // -- depend on the threads that created them. Order them by
+    // -- structure so that every run gives the same clauses
+    canonicalizeHornClauseDB (m_db);
+
+    if (!SaveDb.empty ()) m_db.save (SaveDb);
     return Changed;
   }
 
@@ -193,6 +272,119 @@ namespace seahorn
   {
     // -- skip functions without a body
     if (F.isDeclaration () || F.empty ()) return false;
+
+    /// -- allocate LiveSymbols
+    auto r = m_ls.insert (std::make_pair (&F, LiveSymbols (F, m_efac, *m_sem)));
+    assert (r.second);
+    if (m_cache) encodeFunctionCached (F);
+    else encodeFunction (F);
+    return false;
+  }
+
+  std::string HornifyModule::cacheKey (const Function &F)
+  {
+    std::string desc;
+    raw_string_ostream os (desc);
+    
+    os << "format " << CacheFormat << " step " << Step << " lvl " << TL
+       << " interproc " << InterProc
+       << " slice-side " << HornifyFunction::slicesSide ();
+    if (const UfoSmallSymExec *ufo = dynamic_cast<const UfoSmallSymExec*> (m_sem.get ()))
+      os << " bv " << ufo->isBv ()
+         << " simplify-mem " << ufo->simplifiesMem ()
+         << " global " << ufo->hasGlobalConstraints ();
+    os << " canfail " << getAnalysis<CanFail> ().canFail (&F) << "\n";
+    // -- offsets and bit-vector widths come from the data layout
+    os << "layout " << F.getParent ()->getDataLayoutStr () << "\n";
+    F.print (os);
+    
+    // -- bodies of the struct types of F, which F.print () only names
+    SmallPtrSet<Type*, 16> seenTy;
+    std::vector<Type*> tys;
+    auto addTy = [&] (Type *t) { if (seenTy.insert (t).second) tys.push_back (t); };
+    addTy (F.getFunctionType ());
+    for (const BasicBlock &bb : F)
+      for (const Instruction &inst : bb)
+      {
+        addTy (inst.getType ());
+        for (const Use &u : inst.operands ()) addTy (u->getType ());
+      }
+    for (unsigned i = 0; i < tys.size (); ++i)
+    {
+      for (auto it = tys [i]->subtype_begin (), end = tys [i]->subtype_end (); 
+           it != end; ++it)
+        addTy (*it);
+      StructType *st = dyn_cast<StructType> (tys [i]);
+      if (!st || !st->hasName () || st->isOpaque ()) continue;
+      os << "type " << st->getName () << (st->isPacked () ? " = packed" : " =");
+      for (auto it = st->element_begin (), end = st->element_end (); it != end; ++it)
+        os << " " << **it;
+      os << "\n";
+    }
+    
+    // -- summaries of the callees, in the order of the calls
+    SmallStepSymExec &sem = symExec ();
+    SmallPtrSet<const Function*, 16> seen;
+    for (const BasicBlock &bb : F)
+      for (const Instruction &inst : bb)
+      {
+        ImmutableCallSite CS (&inst);
+        const Function *cf = CS ? CS.getCalledFunction () : nullptr;
+        if (!cf || !sem.hasFunctionInfo (*cf) || !seen.insert (cf).second) continue;
+        
+        const FunctionInfo &fi = sem.getFunctionInfo (*cf);
+        os << "callee " << cf->getName () << " " << *fi.sumPred;
+        for (const Value *v : fi.regions) os << " " << v->getName ();
+        for (const Argument *a : fi.args) os << " " << a->getArgNo ();
+        for (const GlobalVariable *g : fi.globals) os << " " << g->getName ();
+        if (fi.ret) os << " " << fi.ret->getName ();
+        os << "\n";
+      }
+    
+    return HornifyCache::key (os.str ());
+  }
+  
+  void HornifyModule::encodeFunctionCached (Function &F)
+  {
+    std::string key = cacheKey (F);
+    HornifyCacheEntry entry (m_efac);
+    LiveSymbols &ls = m_ls.find (&F)->second;
+    
+    if (m_cache->load (key, *m_resolver, entry))
+    {
+      LOG ("horn-cache", errs () << "HornifyModule: cached: " << F.getName () << "\n");
+      for (auto &kv : entry.live) ls.setLive (kv.first, kv.second);
+      if (entry.hasInfo) symExec ().getFunctionInfo (F) = entry.info;
+      // -- block predicates are taken from the entry since they
+      // -- depend on the order of the live symbols
+      {
+        std::lock_guard<std::mutex> lock (m_bbPredsLock);
+        for (auto &rel : entry.db.getRelations ())
+          if (isOpX<BB> (bind::fname (rel)))
+            m_bbPreds [getTerm<const BasicBlock*> (bind::fname (rel))] = rel;
+      }
+      getHornClauseDB ().merge (entry.db);
+      return;
+    }
+    
+    // -- encode into the database of the entry
+    Context *outer = s_ctx;
+    Context ctx = {&symExec (), &entry.db};
+    s_ctx = &ctx;
+    encodeFunction (F);
+    s_ctx = outer;
+    
+    for (const BasicBlock &bb : F)
+      if (hasBbPredicate (bb)) entry.live.push_back (std::make_pair (&bb, ls.live (&bb)));
+    entry.hasInfo = symExec ().hasFunctionInfo (F);
+    if (entry.hasInfo) entry.info = symExec ().getFunctionInfo (F);
+    
+    m_cache->save (key, entry);
+    getHornClauseDB ().merge (entry.db);
+  }
+
+  void HornifyModule::encodeFunction (Function &F)
+  {
     LOG("horn-step", errs () << "HornifyModule: runOnFunction: " << F.getName () << "\n");
 
 
@@ -200,21 +392,128 @@ namespace seahorn
     //CutPointGraph &cpg = getAnalysis<CutPointGraph> (F);
     boost::scoped_ptr<HornifyFunction> hf (new SmallHornifyFunction
                                            (*this, InterProc));
-    if (Step == hm_detail::LARGE_STEP)
+    if (Step == hm_detail::MEDIUM_STEP)
+      hf.reset (new MediumHornifyFunction (*this, InterProc));
+    else if (Step == hm_detail::LARGE_STEP)
       hf.reset (new LargeHornifyFunction (*this, InterProc));
+    else if (Step == hm_detail::MERGE_LARGE_STEP)
+      hf.reset (new LargeHornifyFunction (*this, InterProc, true));
     else if (Step == hm_detail::FLAT_LARGE_STEP)
       hf.reset (new FlatLargeHornifyFunction (*this, InterProc));
 
 
-    /// -- allocate LiveSymbols
-    auto r = m_ls.insert (std::make_pair (&F, LiveSymbols (F, m_efac, *m_sem)));
-    assert (r.second);
     /// -- run LiveSymbols
-    r.first->second.run ();
+    auto it = m_ls.find (&F);
+    assert (it != m_ls.end ());
+    it->second.run ();
 
     /// -- hornify function
     hf->runOnFunction (F);
+  }
+
+  SmallStepSymExec *HornifyModule::cloneSymExec () const
+  {
+    if (Step == hm_detail::CLP_SMALL_STEP)
+      return new ClpSmallSymExec (static_cast<const ClpSmallSymExec&> (*m_sem));
+    return new UfoSmallSymExec (static_cast<const UfoSmallSymExec&> (*m_sem));
+  }
+
+  bool HornifyModule::runParallel (Module &M, CallGraph &CG)
+  {
+    // -- struct layouts are cached lazily by DataLayout. Compute them
+    // -- now so that the workers only read the cache
+    TypeFinder types;
+    types.run (M, false);
+    for (StructType *st : types)
+      if (!st->isOpaque () && st->isSized ()) m_td->getStructLayout (st);
+
+    // -- SCCs in bottom-up order. Only callee summaries create
+    // -- dependencies, so an SCC is encoded in the wave that follows
+    // -- the last wave of its callees
+    std::vector<Function*> fns;
+    std::vector<unsigned> waves;
+    DenseMap<const CallGraphNode*, unsigned> sccOf;
+    unsigned numWaves = 0;
+    for (auto it = scc_begin (&CG); !it.isAtEnd (); ++it)
+    {
+      const std::vector<CallGraphNode*> &scc = *it;
+      Function *f = scc.front ()->getFunction ();
+      if (it.hasLoop () || scc.size () > 1)
+        errs () << "WARNING RECURSION at " << (f ? f->getName () : "nil") << "\n";
+      if (f && (f->isDeclaration () || f->empty ())) f = nullptr;
+
+      unsigned wave = 0;
+      if (InterProc)
+        for (CallGraphNode *cgn : scc)
+          for (auto &callee : *cgn)
+          {
+            auto s = sccOf.find (callee.second);
+            if (s == sccOf.end ()) continue;
+            wave = std::max (wave, waves [s->second] + (fns [s->second] ? 1 : 0));
+          }
+
+      for (CallGraphNode *cgn : scc) sccOf [cgn] = fns.size ();
+      fns.push_back (f);
+      waves.push_back (wave);
+      if (f) numWaves = std::max (numWaves, wave + 1);
+    }
+
+    // -- one database per SCC, merged in SCC order at the end so that
+    // -- relations and rules are in the order of a sequential run. The
+    // -- ids of new nodes depend on the interleaving of the workers;
+    // -- runOnModule orders the rules by structure after the merge
+    boost::ptr_vector<HornClauseDB> dbs;
+    std::vector<Context> ctxs (fns.size ());
+    for (unsigned i = 0; i < fns.size (); ++i) dbs.push_back (new HornClauseDB (m_efac));
+
+    for (unsigned wave = 0; wave < numWaves; ++wave)
+    {
+      // -- contexts and live symbols are allocated sequentially. The
+      // -- workers only read the shared maps
+      std::vector<unsigned> tasks;
+      for (unsigned i = 0; i < fns.size (); ++i)
+      {
+        if (!fns [i] || waves [i] != wave) continue;
+        tasks.push_back (i);
+        m_ctxSems.push_back (cloneSymExec ());
+        ctxs [i].sem = &m_ctxSems.back ();
+        ctxs [i].db = &dbs [i];
+        auto r = m_ls.insert (std::make_pair (fns [i], LiveSymbols (*fns [i], m_efac,
+                                                                   *ctxs [i].sem)));
+        assert (r.second);
+      }
+      
+      LOG ("horn-threads",
+           errs () << "HornifyModule: wave " << wave << ": "
+                   << tasks.size () << " functions\n");
+
+      std::atomic<unsigned> next (0);
+      auto work = [&] ()
+      {
+        for (unsigned k = next++; k < tasks.size (); k = next++)
+        {
+          s_ctx = &ctxs [tasks [k]];
+          if (m_cache) encodeFunctionCached (*fns [tasks [k]]);
+          else encodeFunction (*fns [tasks [k]]);
+          s_ctx = nullptr;
+        }
+      };
+
+      m_efac.setConcurrent (true);
+      std::vector<std::thread> workers;
+      for (unsigned t = 0, n = std::min<unsigned> (Threads, tasks.size ()); t < n; ++t)
+        workers.push_back (std::thread (work));
+      for (auto &w : workers) w.join ();
+      m_efac.setConcurrent (false);
+
+      // -- publish the summaries of the wave to the callers
+      for (unsigned i : tasks)
+        if (ctxs [i].sem->hasFunctionInfo (*fns [i]))
+          m_sem->getFunctionInfo (*fns [i]) = ctxs [i].sem->getFunctionInfo (*fns [i]);
+    }
 
+    for (unsigned i = 0; i < fns.size (); ++i)
+      if (fns [i]) m_db.merge (dbs [i]);
     return false;
   }
 
@@ -244,6 +543,7 @@ namespace seahorn
   const Expr HornifyModule::bbPredicate (const BasicBlock &BB)
   {
     const BasicBlock *bb = &BB;
+    std::lock_guard<std::mutex> lock (m_bbPredsLock);
     Expr res = m_bbPreds [bb];
     if (res) return res;
 
@@ -0,0 +1,210 @@
+#include "seahorn/InvariantStore.hh"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/Function.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MD5.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "ufo/ExprLlvm.hpp"
+
+#include <cstring>
+
+namespace seahorn
+{
+  using namespace llvm;
+
+  namespace
+  {
+    /// "SHIV" as a little-endian word
+    const uint32_t STORE_MAGIC = 0x56494853;
+    const uint32_t STORE_VERSION = 1;
+
+    /// lemma over the bound variables of the arguments of a relation,
+    /// instantiated at the application app
+    Expr instantiate (Expr lemma, Expr app)
+    {
+      ExprMap sub;
+      unsigned idx = 0;
+      for (auto it = ++app->args_begin (), end = app->args_end (); it != end; ++it)
+        sub [bind::bvar (idx++, bind::typeOf (*it))] = *it;
+      return replace (lemma, sub);
+    }
+  }
+
+  std::string InvariantStore::key (const BasicBlock &bb)
+  {
+    std::string desc;
+    raw_string_ostream os (desc);
+    os << bb.getParent ()->getName () << " " << bb.getName () << "\n";
+    bb.print (os);
+    
+    MD5 md5;
+    md5.update (os.str ());
+    MD5::MD5Result res;
+    md5.final (res);
+    SmallString<32> str;
+    MD5::stringifyResult (res, str);
+    return std::string (str.begin (), str.end ());
+  }
+
+  bool InvariantStore::save (StringRef file) const
+  {
+    ExprWriter w;
+    std::vector<uint32_t> words;
+    words.push_back (0);
+    for (auto &kv : m_invs)
+    {
+      ExprVector lemmas;
+      for (auto &l : kv.second)
+      {
+        ExprWriter probe;
+        probe.add (l);
+        if (probe.ok ()) lemmas.push_back (l);
+      }
+      if (lemmas.empty ()) continue;
+
+      ++words [0];
+      words.push_back (w.add (mkTerm<std::string> (kv.first,
+                                                   lemmas.front ()->efac ())));
+      words.push_back (lemmas.size ());
+      for (auto &l : lemmas) words.push_back (w.add (l));
+    }
+
+    std::error_code ec;
+    llvm::tool_output_file out (file.str ().c_str (), ec, llvm::sys::fs::F_None);
+    if (ec)
+    {
+      errs () << "ERROR: Cannot open " << file << ": " << ec.message () << "\n";
+      return false;
+    }
+
+    const uint32_t hdr [] = {STORE_MAGIC, STORE_VERSION};
+    out.os ().write (reinterpret_cast<const char*> (hdr), sizeof (hdr));
+    w.write (out.os ());
+    out.os ().write (reinterpret_cast<const char*> (words.data ()),
+                     words.size () * sizeof (uint32_t));
+    out.keep ();
+    return true;
+  }
+
+  bool InvariantStore::load (StringRef file, ExprFactory &efac,
+                             const ExprValueResolver &resolver)
+  {
+    ErrorOr<std::unique_ptr<MemoryBuffer> > buf =
+      MemoryBuffer::getFile (file, -1, false);
+    if (!buf) return false;
+
+    StringRef data = (*buf)->getBuffer ();
+    // -- the words are read in place unless the buffer is not aligned
+    std::vector<uint32_t> copy;
+    const uint32_t *p = reinterpret_cast<const uint32_t*> (data.data ());
+    if (reinterpret_cast<uintptr_t> (p) % alignof (uint32_t) != 0)
+    {
+      copy.resize (data.size () / sizeof (uint32_t));
+      std::memcpy (copy.data (), data.data (), copy.size () * sizeof (uint32_t));
+      p = copy.data ();
+    }
+    const uint32_t *end = p + data.size () / sizeof (uint32_t);
+
+    if (data.size () % sizeof (uint32_t) != 0 || end - p < 2 ||
+        p [0] != STORE_MAGIC || p [1] != STORE_VERSION)
+    {
+      errs () << "ERROR: " << file << " is not an invariant store\n";
+      return false;
+    }
+    p += 2;
+
+    ExprReader reader (efac, &resolver);
+    p = reader.read (p, end);
+
+    auto word = [&] (uint32_t &w)
+      {
+        if (!p || p == end) return false;
+        w = *p++;
+        return true;
+      };
+    auto expr = [&] (Expr &e)
+      {
+        uint32_t idx;
+        if (!word (idx)) return false;
+        e = reader.get (idx);
+        return e != nullptr;
+      };
+
+    std::map<std::string, ExprVector> invs;
+    bool ok = true;
+    uint32_t n = 0;
+    ok = ok && word (n);
+    for (uint32_t i = 0; ok && i < n; ++i)
+    {
+      Expr k;
+      uint32_t sz = 0;
+      ok = expr (k) && isOpX<STRING> (k) && word (sz);
+      ExprVector &lemmas = invs [ok ? getTerm<std::string> (k) : std::string ()];
+      for (uint32_t j = 0; ok && j < sz; ++j)
+      {
+        Expr l;
+        ok = expr (l);
+        lemmas.push_back (l);
+      }
+    }
+
+    if (!ok || p != end)
+    {
+      errs () << "ERROR: " << file << " is not a valid invariant store\n";
+      return false;
+    }
+
+    m_invs.swap (invs);
+    return true;
+  }
+
+  void validateInvariants (const HornClauseDB &db, ufo::EZ3 &zctx,
+                           std::map<Expr, ExprVector> &invs)
+  {
+    // -- Houdini: drop the lemmas of a rule head that the rule does
+    // -- not imply, until no more lemmas are dropped
+    bool changed = true;
+    while (changed)
+    {
+      changed = false;
+      for (auto &rule : db.getRules ())
+      {
+        Expr head = rule.head ();
+        if (!bind::isFapp (head)) continue;
+        auto it = invs.find (bind::fname (head));
+        if (it == invs.end () || it->second.empty ()) continue;
+
+        ufo::ZSolver<ufo::EZ3> solver (zctx);
+        solver.assertExpr (rule.body ());
+
+        ExprVector apps;
+        filter (rule.body (),
+                [&db] (Expr e)
+                {return bind::isFapp (e) && db.hasRelation (bind::fname (e));},
+                std::back_inserter (apps));
+        for (auto &app : apps)
+        {
+          auto b = invs.find (bind::fname (app));
+          if (b == invs.end ()) continue;
+          for (auto &l : b->second) solver.assertExpr (instantiate (l, app));
+        }
+
+        ExprVector kept;
+        for (auto &l : it->second)
+        {
+          solver.push ();
+          solver.assertExpr (mk<NEG> (instantiate (l, head)));
+          boost::tribool res = solver.solve ();
+          solver.pop ();
+          if (!res) kept.push_back (l);
+          else changed = true;
+        }
+        it->second.swap (kept);
+      }
+    }
+  }
+}
@@ -1,4 +1,5 @@
 #include "seahorn/LiveSymbols.hh"
+#include "seahorn/ExprOrder.hh"
 
 #include "boost/range.hpp"
 #include "boost/range/algorithm.hpp"
@@ -11,49 +12,32 @@
 namespace seahorn
 {
     
-  void LiveInfo::setLive (const ExprVector &l)
+  unsigned LiveSymbols::symbolIdx (Expr v)
   {
-    m_live.assign (l.begin (), l.end ());
-    boost::sort (m_live);
-  }
-    
-  void LiveInfo::setDefs (const ExprVector &d)
-  {
-    m_defs.assign (d.begin (), d.end ());
-    boost::sort (m_defs);
-  }
-    
-  void LiveInfo::addEdgeDef (const ExprVector &d)
-  {
-    m_edgeDefs.push_back (ExprVector ());
-    ExprVector &defs = m_edgeDefs.back ();
-    defs.assign (d.begin (), d.end ());
-    boost::sort (defs);
-  }
+    auto it = m_symbolIdx.find (&*v);
+    if (it != m_symbolIdx.end ()) return it->second;
     
-  void LiveInfo::addLive (ExprVector &v)
-  {
-    if (v.size () == 0) return;
-      
-    boost::sort (v);
-    size_t sz = m_live.size ();
-    m_live.reserve (sz + v.size ());
-      
-    boost::copy (v, std::back_inserter (m_live));
-    std::inplace_merge (m_live.begin (), m_live.begin () + sz, m_live.end ());
+    unsigned idx = m_symbols.size ();
+    if (m_sorted && !m_symbols.empty () &&
+        ExprOrder ().less (v, m_symbols.back ()))
+      m_sorted = false;
+    m_symbols.push_back (v);
+    m_symbolIdx [&*v] = idx;
+    return idx;
   }
   
-  /// like add live but v might contain already live variables
-  void LiveInfo::unionLive (ExprVector &v)
+  BitVector LiveSymbols::toBits (const ExprVector &v)
   {
-    boost::sort (v);
-    ExprVector newLive;
-    newLive.reserve (v.size ());
-    boost::set_difference (v, m_live, std::back_inserter (newLive));
-    addLive (newLive);
+    BitVector res (m_symbols.size ());
+    for (const Expr &e : v)
+    {
+      unsigned idx = symbolIdx (e);
+      resize (res);
+      res.set (idx);
+    }
+    return res;
   }
   
-    
   void LiveSymbols::run ()
   {
     localPass ();
@@ -72,7 +56,7 @@ namespace seahorn
   {
     errs () << "Function: " << m_f.getName () << "\n";
     for (auto &entry : m_liveInfo)
-      errs () << entry.first->getName () << ": " << entry.second.live ().size () << "\n";
+      errs () << entry.first->getName () << ": " << entry.second.live ().count () << "\n";
     
   }
   
@@ -81,10 +65,11 @@ namespace seahorn
   {
     LiveInfo &li = m_liveInfo [&m_f.getEntryBlock ()];
     
-    ExprVector extras;
+    BitVector extras (m_symbols.size ());
     
-    for (Expr v : li.live ())
+    for (int i = li.live ().find_first (); i >= 0; i = li.live ().find_next (i))
     {
+      Expr v = m_symbols [i];
       assert (bind::isFapp (v));
       Expr u = bind::fname (bind::fname (v));
       if (!isOpX<VALUE> (u)) continue;
@@ -92,26 +77,43 @@ namespace seahorn
       const Value *val = getTerm<const Value*> (u);
       
       if (isa<Argument> (val) || isa<GlobalVariable> (val))
-        extras.push_back (v);
+        extras.set (i);
     }
     
     // find block with return and make extras live there
     for (const BasicBlock *bb : m_rtopo)
       if (isa<ReturnInst> (bb->getTerminator ()))
       {
-        m_liveInfo [bb].addLive (extras);
+        LiveInfo &ret = m_liveInfo [bb];
+        ret.m_live |= extras;
+        ret.m_dirty = true;
         break;
       }
   }
   
+  namespace
+  {
+    /// symbols read and written by a basic block and by the phi-nodes
+    /// on each of its outgoing edges
+    struct LocalUses
+    {
+      ExprVector uses;
+      ExprVector defs;
+      std::vector<std::pair<ExprVector, ExprVector> > edges;
+    };
+  }
   
   void LiveSymbols::localPass ()
   {
     RevTopoSort (m_f, m_rtopo);
-      
-    for (const BasicBlock *bb : m_rtopo)
+    
+    std::vector<LocalUses> local (m_rtopo.size ());
+    ExprVector symbols;
+    
+    for (unsigned i = 0; i < m_rtopo.size (); ++i)
     {
-      LiveInfo &li = m_liveInfo [bb];
+      const BasicBlock *bb = m_rtopo [i];
+      LocalUses &lu = local [i];
       
       // // -- no live variables at any terminal basic block of the main function
       // if (llvm::succ_begin (bb) == llvm::succ_end (bb) && 
@@ -129,31 +131,49 @@ namespace seahorn
            );
             
       // -- live and defs based on what is read/written by symbolic execution
-      li.setLive (s.uses ());
-      li.setDefs (s.defs ());
+      lu.uses = s.uses ();
+      lu.defs = s.defs ();
+      symbols.insert (symbols.end (), lu.uses.begin (), lu.uses.end ());
+      symbols.insert (symbols.end (), lu.defs.begin (), lu.defs.end ());
         
-      // -- execute phi-nodes on the edges and update block's live
-      // -- symbols and edge definitions
+      // -- execute phi-nodes on the edges
       for (auto it = llvm::succ_begin (bb), end = llvm::succ_end (bb); 
            it != end; ++it)
       {
         SymStore ss (m_gstore, true);
         // -- execute the phi-nodes
         symExecPhi (ss, *(*it), *bb);
-          
-        li.addEdgeDef (ss.defs ());
-          
-        // compute extra live variables by finding new uses at the edge
-        ExprVector uses (ss.uses ().size ());
-        boost::copy (ss.uses (), uses.begin ());
-        boost::sort (uses);
-          
-        ExprVector uses2;
-        uses2.reserve (uses.size ());
-        boost::set_difference (uses, li.defs (), std::back_inserter (uses2));
-        uses.clear ();
-        boost::set_difference (uses2, li.live (), std::back_inserter (uses));
-        li.addLive (uses);
+        lu.edges.push_back (std::make_pair (ss.uses (), ss.defs ()));
+        symbols.insert (symbols.end (), ss.uses ().begin (), ss.uses ().end ());
+        symbols.insert (symbols.end (), ss.defs ().begin (), ss.defs ().end ());
+      }
+    }
+    
+    // -- number the symbols in ExprOrder so that the live vectors come
+    // -- out sorted. Unlike the order on Expr, it does not depend on
+    // -- the threads that created the symbols
+    ExprOrder order;
+    order.sort (symbols);
+    symbols.erase (std::unique (symbols.begin (), symbols.end ()), symbols.end ());
+    for (const Expr &v : symbols) symbolIdx (v);
+    
+    for (unsigned i = 0; i < m_rtopo.size (); ++i)
+    {
+      LiveInfo &li = m_liveInfo [m_rtopo [i]];
+      LocalUses &lu = local [i];
+      
+      li.m_live = toBits (lu.uses);
+      li.m_defs = toBits (lu.defs);
+      li.m_dirty = true;
+      
+      // -- uses on an edge that are not defined by the block are live
+      // -- at its entry
+      for (auto &edge : lu.edges)
+      {
+        li.m_edgeDefs.push_back (toBits (edge.second));
+        BitVector uses = toBits (edge.first);
+        uses.reset (li.m_defs);
+        li.m_live |= uses;
       }
       // -- at this point local live information for bb is computed
     }
@@ -166,45 +186,54 @@ namespace seahorn
   void LiveSymbols::globalPass ()
   {
     // -- propagate live symbol information until nothing can be propagated
-    // -- based on local live symbol information computed by initialize()
-    bool dirty;
-    do
+    // -- based on local live symbol information computed by localPass ().
+    // -- The worklist is a set of positions in m_rtopo. It is swept in
+    // -- reverse topological order, so that successors come before
+    // -- their predecessors, and a block that changes schedules its
+    // -- predecessors for the current or the next sweep
+    DenseMap<const BasicBlock*, unsigned> pos;
+    for (unsigned i = 0; i < m_rtopo.size (); ++i) pos [m_rtopo [i]] = i;
+    
+    BitVector pending (m_rtopo.size (), true);
+    BitVector live;
+    int i = pending.find_first ();
+    while (i >= 0)
     {
-      dirty = false;
-      for (const BasicBlock *src : m_rtopo)
+      pending.reset (i);
+      const BasicBlock *src = m_rtopo [i];
+      LiveInfo &srcLi = m_liveInfo [src];
+      
+      unsigned idx = 0;
+      bool changed = false;
+      for (const BasicBlock *dst : 
+             boost::make_iterator_range (succ_begin (src), succ_end (src)))
       {
-        unsigned idx = 0;
-        LiveInfo &srcLi = m_liveInfo[src];
-          
-        for (const BasicBlock *dst : 
-               boost::make_iterator_range (succ_begin (src), succ_end (src)))
+        live = m_liveInfo [dst].live ();
+        live.reset (srcLi.edge_defs (idx++));
+        live.reset (srcLi.defs ());
+        live.reset (srcLi.live ());
+        
+        if (live.any ())
         {
-          LiveInfo &dstLi = m_liveInfo[dst];
-            
-          ExprVector live;
-          live.reserve (dstLi.live ().size ());
-            
-          ExprVector live2;
-          live2.reserve (live.size ());
-            
-          boost::set_difference (dstLi.live (), 
-                                 srcLi.edge_defs (idx++), 
-                                 std::back_inserter (live));
-          boost::set_difference (live, srcLi.defs (), 
-                                 std::back_inserter (live2));
-            
-          live.clear ();
-          boost::set_difference (live2, srcLi.live (), 
-                                 std::back_inserter (live));
-            
-          if (!live.empty ())
-          {
-            dirty = true;
-            srcLi.addLive (live);
-          }
+          srcLi.m_live |= live;
+          changed = true;
+        }
+      }
+      
+      if (changed)
+      {
+        srcLi.m_dirty = true;
+        for (const BasicBlock *pred : 
+               boost::make_iterator_range (pred_begin (src), pred_end (src)))
+        {
+          auto it = pos.find (pred);
+          if (it != pos.end ()) pending.set (it->second);
         }
       }
-    } while (dirty);
+      
+      int next = pending.find_next (i);
+      i = next >= 0 ? next : pending.find_first ();
+    }
   }  
   
   void LiveSymbols::symExec (SymStore &s, const BasicBlock &bb) 
@@ -224,10 +253,37 @@ namespace seahorn
   {
     auto it = m_liveInfo.find (bb);
     assert (it != m_liveInfo.end ());
-    return it->second.live ();
+    const LiveInfo &li = it->second;
+    
+    if (li.m_dirty)
+    {
+      li.m_liveExprs.clear ();
+      li.m_liveExprs.reserve (li.live ().count ());
+      for (int i = li.live ().find_first (); i >= 0; i = li.live ().find_next (i))
+        li.m_liveExprs.push_back (m_symbols [i]);
+      if (!m_sorted) ExprOrder ().sort (li.m_liveExprs);
+      li.m_dirty = false;
+    }
+    return li.m_liveExprs;
+  }
+  
+  void LiveSymbols::setLive (const BasicBlock *bb, const ExprVector &live)
+  {
+    LiveInfo &li = m_liveInfo [bb];
+    li.m_live = toBits (live);
+    li.m_liveExprs = live;
+    li.m_dirty = false;
   }
   
   void LiveSymbols::globallyLive (ExprVector &live)
-  {for (auto &kv : m_liveInfo) kv.second.unionLive (live);} 
+  {
+    BitVector bits = toBits (live);
+    for (auto &kv : m_liveInfo) 
+    {
+      LiveInfo &li = kv.second;
+      resize (li.m_live);
+      li.m_live |= bits;
+      li.m_dirty = true;
+    }
+  } 
 }
-
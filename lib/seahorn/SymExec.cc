@@ -77,6 +77,56 @@ namespace
 
 namespace seahorn
 {
+  void SymTransition::apply (SymStore &s, ExprVector &out, Expr a) const
+  {
+    // -- maps recorded values to the values in s
+    ExprMap sub;
+    if (act && act != a) sub [act] = a;
+    for (const SymStore::Op &op : ops)
+    {
+      Expr v = op.havoc ? s.havoc (op.key) : s.read (op.key);
+      if (v != op.val) sub [op.val] = v;
+    }
+    
+    if (sub.empty ())
+    {
+      out.insert (out.end (), side.begin (), side.end ());
+      return;
+    }
+    
+    // -- side constraints of a block share sub-terms
+    RV<ExprMap> rv (sub);
+    DagVisitCache cache;
+    for (const Expr &e : side) out.push_back (visit (rv, e, cache));
+    clearDagVisitCache (cache);
+  }
+  
+  void SmallStepSymExec::execTransition (SymStore &s, const BasicBlock &bb,
+                                         const BasicBlock *from,
+                                         ExprVector &side, Expr act)
+  {
+    // -- a false activation literal disables all side constraints
+    if (isOpX<FALSE> (act))
+    {
+      execUncached (s, bb, from, side, act);
+      return;
+    }
+    
+    bool guarded = !isOpX<TRUE> (act);
+    TransitionMap &cache = guarded ? m_actTrans : m_trueTrans;
+    TransitionKey key (&bb, from);
+    bool fresh = cache.count (key) == 0;
+    SymTransition &t = cache [key];
+    if (fresh)
+    {
+      if (guarded) t.act = m_transAct;
+      SymStore tmpl (m_efac);
+      tmpl.setLog (&t.ops);
+      execUncached (tmpl, bb, from, t.side, guarded ? m_transAct : act);
+    }
+    t.apply (s, side, act);
+  }
+  
   void IntLightSymExec::exec (SymStore &s, const BasicBlock &bb, ExprVector &side)
   {
     SymExecVisitor v(s, *this);
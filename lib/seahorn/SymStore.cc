@@ -19,11 +19,16 @@ namespace seahorn
       
     std::swap (m_Parent, o.m_Parent);
     std::swap (m_ownedParent, o.m_ownedParent);
-    std::swap (m_Store, o.m_Store);
+    m_Store.swap (o.m_Store);
     std::swap (m_trackUse, o.m_trackUse);
     std::swap (m_uses, o.m_uses);
     std::swap (m_defs, o.m_defs);
     std::swap (m_defs_sz, o.m_defs_sz);
+    // -- memoized results go with the store they were computed for
+    m_evalMemo.swap (o.m_evalMemo);
+    std::swap (m_version, o.m_version);
+    std::swap (m_variants, o.m_variants);
+    m_valueDefs.swap (o.m_valueDefs);
   }  
   
   void SymStore::print (llvm::raw_ostream &out)
@@ -39,7 +44,10 @@ namespace seahorn
   { 
     assert (!isValue (key));
     
-    m_Store[key] = val; 
+    // -- a result of eval () can only depend on key if eval () has
+    // -- visited key
+    if (m_evalMemo && m_evalMemo->count (&*key)) m_evalMemo->clear ();
+    m_Store.set (key, val);
     if (m_trackUse) m_defs.push_back (key);
   }
     
@@ -54,23 +62,17 @@ namespace seahorn
     if (m_Parent) val = m_Parent->havoc (key);
     else 
     {
-      val = at (key);
-      
-      Expr fdecl = val ? bind::fname (val) : bind::fname (key);
-        
-      Expr fname = bind::fname (fdecl);
-      int idx = 0;
-      if (val)
-      {
-        idx = variant::variantNum (fname) + 1;
-        fname = variant::mainVariant (fname);
-      }
-      
-      fname = variant::variant (idx, fname);
-      val = bind::reapp (val ? val : key, bind::rename (fdecl, fname));
+      unsigned idx = 0;
+      auto it = m_version.find (key);
+      if (it != m_version.end ()) idx = it->second + 1;
+      else if (Expr cur = at (key))
+        // -- written directly rather than by havoc () or read ()
+        idx = variant::variantNum (bind::fname (bind::fname (cur))) + 1;
+      val = newVersion (key, idx);
     }
       
     write (key, val);
+    if (m_log) m_log->push_back (Op (true, key, val));
     return val;
   }
     
@@ -80,16 +82,14 @@ namespace seahorn
     if (isValue (key)) return key;
     
     Expr val = at (key);
-    if (val) return val;
+    if (val) 
+    {
+      if (m_log) m_log->push_back (Op (false, key, val));
+      return val;
+    }
       
     if (m_Parent) val = m_Parent->havoc (key);
-    else 
-    {
-      Expr fdecl = bind::fname (key);
-      Expr fname = bind::fname (fdecl);
-      fname = variant::variant (0, fname);
-      val = bind::reapp (key, bind::rename (fdecl, fname));
-    }      
+    else val = newVersion (key, 0);
       
     if (m_trackUse) m_uses.push_back (key);
       
@@ -101,10 +101,30 @@ namespace seahorn
       write (key, val);
     }
       
+    if (m_log) m_log->push_back (Op (false, key, val));
     return val;
   }
   
   
+  /// Versions are (key, number) pairs. The expression for a version,
+  /// key with its name replaced by the VARIANT of the number and the
+  /// name, is built the first time the version is used
+  Expr SymStore::newVersion (Expr key, unsigned idx)
+  {
+    m_version [key] = idx;
+    
+    ExprVector &versions = m_variants [key];
+    if (versions.size () <= idx) versions.resize (idx + 1);
+    Expr &res = versions [idx];
+    if (!res)
+    {
+      Expr fdecl = bind::fname (key);
+      Expr fname = variant::variant (idx, bind::fname (fdecl));
+      res = bind::reapp (key, bind::rename (fdecl, fname));
+    }
+    return res;
+  }
+  
   const ExprVector &SymStore::defs () 
   {
     if (m_defs.size () > m_defs_sz)
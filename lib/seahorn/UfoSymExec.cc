@@ -20,6 +20,28 @@ GlobalConstraints("horn-global-constraints",
                   cl::init (false),
                   cl::Hidden);
 
+static llvm::cl::opt<bool>
+SimplifyMem("horn-simplify-mem",
+            llvm::cl::desc
+            ("Resolve memory reads against the stores that precede them"),
+            cl::init (false),
+            cl::Hidden);
+
+static llvm::cl::opt<bool>
+TransitionCache("horn-transition-cache",
+                llvm::cl::desc
+                ("Execute each basic block and phi-edge once and reuse "
+                 "its symbolic transition relation"),
+                cl::init (false),
+                cl::Hidden);
+
+static llvm::cl::opt<bool>
+BvSemantics("horn-bv",
+            llvm::cl::desc
+            ("Model registers and memory by bit-vectors of their "
+             "DataLayout width"),
+            cl::init (false));
+
 
 namespace
 {
@@ -71,6 +93,108 @@ namespace
     // -- add conditional side condition
     void addCondSide (Expr c) {m_side.push_back (boolop::limp (m_activeLit, c));}
     
+    /// Splits a pointer into a base and a numeric offset, following
+    /// the definitions of pointers in the store. The base of a numeral
+    /// is NULL
+    void splitPtr (Expr p, Expr &base, mpz_class &off)
+    {
+      off = 0;
+      while (true)
+      {
+        if (Expr def = m_s.definition (p)) p = def;
+        else if (isOpX<PLUS> (p) && p->arity () == 2 && isOpX<MPZ> (p->right ()))
+        {
+          off += getTerm<mpz_class> (p->right ());
+          p = p->left ();
+        }
+        else if (isOpX<BADD> (p) && p->arity () == 2 && bv::is_bvnum (p->right ()))
+        {
+          off += getTerm<mpz_class> (p->right ()->arg (0));
+          p = p->left ();
+        }
+        else break;
+      }
+      
+      if (isOpX<MPZ> (p))
+      {
+        off += getTerm<mpz_class> (p);
+        p = Expr (0);
+      }
+      else if (bv::is_bvnum (p))
+      {
+        off += getTerm<mpz_class> (p->arg (0));
+        p = Expr (0);
+      }
+      base = p;
+    }
+    
+    /// 1 if the addresses a and b are equal, 0 if they are
+    /// different, -1 if unknown
+    int cmpAddr (Expr a, Expr b)
+    {
+      if (a == b) return 1;
+      Expr baseA, baseB;
+      mpz_class offA, offB;
+      splitPtr (a, baseA, offA);
+      splitPtr (b, baseB, offB);
+      if (baseA != baseB) return -1;
+      if (m_sem.isBv ())
+      {
+        // -- bit-vector offsets are non-negative and wrap around
+        mpz_class m;
+        mpz_ui_pow_ui (m.get_mpz_t (), 2, m_sem.ptrWidth ());
+        offA %= m;
+        offB %= m;
+      }
+      return offA == offB ? 1 : 0;
+    }
+    
+    /// select (mem, idx), reading through the stores that define mem
+    /// to different addresses
+    Expr memSelect (Expr mem, Expr idx)
+    {
+      if (SimplifyMem)
+        while (Expr def = m_s.definition (mem))
+        {
+          if (!isOpX<STORE> (def)) break;
+          int cmp = cmpAddr (def->arg (1), idx);
+          if (cmp == 1) return def->arg (2);
+          if (cmp < 0) break;
+          mem = def->arg (0);
+        }
+      return op::array::select (mem, idx);
+    }
+    
+    /// store (mem, idx, v), without the store that defines mem if it
+    /// is overwritten
+    Expr memStore (Expr mem, Expr idx, Expr v)
+    {
+      if (SimplifyMem)
+        if (Expr def = m_s.definition (mem))
+          if (isOpX<STORE> (def) && cmpAddr (def->arg (1), idx) == 1)
+            mem = def->arg (0);
+      return op::array::store (mem, idx, v);
+    }
+    
+    /// bit-vector e of width from resized to width to
+    Expr bvResize (Expr e, unsigned from, unsigned to, bool is_signed = false)
+    {
+      if (from == to) return e;
+      if (from > to) return bv::extract (to - 1, 0, e);
+      return is_signed ? bv::sext (e, to) : bv::zext (e, to);
+    }
+    
+    /// bit-vector of a given width for a Boolean. sext maps true to -1
+    Expr bvFromBool (Expr b, unsigned width, bool is_signed = false)
+    {
+      Expr one = m_sem.bvNum (is_signed ? -1 : 1, width);
+      Expr zero = m_sem.bvNum (0, width);
+      if (isOpX<TRUE> (b)) return one;
+      if (isOpX<FALSE> (b)) return zero;
+      return mk<ITE> (b, one, zero);
+    }
+    
+    unsigned bvWidth (const Value &v) {return m_sem.bvWidth (v.getType ());}
   };
   
   struct SymExecVisitor : public InstVisitor<SymExecVisitor>, 
@@ -100,7 +224,9 @@ namespace
 
       Expr res;
       
-      switch (I.getPredicate ())
+      if (m_sem.isBv () && !v0.getType ()->isIntegerTy (1))
+        res = doBvCmp (lhs, I.getPredicate (), op0, op1);
+      else switch (I.getPredicate ())
       {
       case CmpInst::ICMP_EQ:
         res = mk<IFF>(lhs, mk<EQ>(op0,op1));
@@ -134,6 +260,24 @@ namespace
         m_side.push_back (boolop::limp (act, res));
     }
     
+    Expr doBvCmp (Expr lhs, CmpInst::Predicate p, Expr op0, Expr op1)
+    {
+      switch (p)
+      {
+      case CmpInst::ICMP_EQ: return mk<IFF> (lhs, mk<EQ> (op0, op1));
+      case CmpInst::ICMP_NE: return mk<IFF> (lhs, mk<NEQ> (op0, op1));
+      case CmpInst::ICMP_UGT: return mk<IFF> (lhs, mk<BUGT> (op0, op1));
+      case CmpInst::ICMP_SGT: return mk<IFF> (lhs, mk<BSGT> (op0, op1));
+      case CmpInst::ICMP_UGE: return mk<IFF> (lhs, mk<BUGE> (op0, op1));
+      case CmpInst::ICMP_SGE: return mk<IFF> (lhs, mk<BSGE> (op0, op1));
+      case CmpInst::ICMP_ULT: return mk<IFF> (lhs, mk<BULT> (op0, op1));
+      case CmpInst::ICMP_SLT: return mk<IFF> (lhs, mk<BSLT> (op0, op1));
+      case CmpInst::ICMP_ULE: return mk<IFF> (lhs, mk<BULE> (op0, op1));
+      case CmpInst::ICMP_SLE: return mk<IFF> (lhs, mk<BSLE> (op0, op1));
+      default: return Expr (0);
+      }
+    }
+    
     void visitSelectInst(SelectInst &I)
     {
       if (!m_sem.isTracked (I)) return;
@@ -155,6 +299,12 @@ namespace
       
       Expr lhs = havoc (I);
       
+      if (m_sem.isBv () && !I.getType ()->isIntegerTy (1))
+      {
+        doBvArithmetic (lhs, I);
+        return;
+      }
+      
       switch (I.getOpcode ())
       {
       case BinaryOperator::Add:
@@ -266,6 +416,36 @@ namespace
       if (res) m_side.push_back (boolop::limp (act, res));
     }
     
+    void doBvArithmetic (Expr lhs, BinaryOperator &i)
+    {
+      Expr op1 = lookup (*i.getOperand (0));
+      Expr op2 = lookup (*i.getOperand (1));
+
+      if (!(op1 && op2)) return;
+
+      Expr rhs;
+      switch (i.getOpcode ())
+      {
+      case BinaryOperator::Add: rhs = mk<BADD> (op1, op2); break;
+      case BinaryOperator::Sub: rhs = mk<BSUB> (op1, op2); break;
+      case BinaryOperator::Mul: rhs = mk<BMUL> (op1, op2); break;
+      case BinaryOperator::UDiv: rhs = mk<BUDIV> (op1, op2); break;
+      case BinaryOperator::SDiv: rhs = mk<BSDIV> (op1, op2); break;
+      case BinaryOperator::URem: rhs = mk<BUREM> (op1, op2); break;
+      case BinaryOperator::SRem: rhs = mk<BSREM> (op1, op2); break;
+      case BinaryOperator::Shl: rhs = mk<BSHL> (op1, op2); break;
+      case BinaryOperator::LShr: rhs = mk<BSHR> (op1, op2); break;
+      case BinaryOperator::AShr: rhs = mk<BASHR> (op1, op2); break;
+      case BinaryOperator::And: rhs = mk<BAND> (op1, op2); break;
+      case BinaryOperator::Or: rhs = mk<BOR> (op1, op2); break;
+      case BinaryOperator::Xor: rhs = mk<BXOR> (op1, op2); break;
+      default: break;
+      }
+
+      Expr act = GlobalConstraints ? trueE : m_activeLit;
+      if (rhs) m_side.push_back (boolop::limp (act, mk<EQ> (lhs, rhs)));
+    }
+    
     void visitReturnInst (ReturnInst &I)
     {
       // -- skip return argument of main
@@ -289,7 +469,16 @@ namespace
       if (!op0) return;
 
       Expr act = GlobalConstraints ? trueE : m_activeLit;
-      if (I.getType ()->isIntegerTy (1))
+      if (m_sem.isBv ())
+      {
+        unsigned width = bvWidth (I);
+        Expr rhs = bv::extract (width - 1, 0, op0);
+        if (I.getType ()->isIntegerTy (1))
+          m_side.push_back (boolop::limp (act, mk<IFF> (lhs, mk<EQ> (rhs, m_sem.bvNum (1, 1)))));
+        else
+          m_side.push_back (boolop::limp (act, mk<EQ> (lhs, rhs)));
+      }
+      else if (I.getType ()->isIntegerTy (1))
       {
         Expr zero = mkTerm<mpz_class> (0, m_efac);
         Expr one = mkTerm<mpz_class> (1, m_efac);
@@ -324,7 +513,10 @@ namespace
       
       Expr op = m_sem.ptrArith (m_s, *gep.getPointerOperand (), ps, ts);
       Expr act = GlobalConstraints ? trueE : m_activeLit;
-      if (op) m_side.push_back (boolop::limp (act, mk<EQ> (lhs, op)));
+      if (!op) return;
+      m_side.push_back (boolop::limp (act, mk<EQ> (lhs, op)));
+      // -- the side condition holds wherever lhs is used
+      m_s.define (lhs, op);
     }
     
     void doExtCast (CastInst &I, bool is_signed = false)
@@ -335,6 +527,16 @@ namespace
       
       if (!op0) return;
       
+      Expr act = GlobalConstraints ? trueE : m_activeLit;
+      if (m_sem.isBv ())
+      {
+        op0 = v0.getType ()->isIntegerTy (1) ?
+          bvFromBool (op0, bvWidth (I), is_signed) :
+          bvResize (op0, bvWidth (v0), bvWidth (I), is_signed);
+        m_side.push_back (boolop::limp (act, mk<EQ> (lhs, op0)));
+        return;
+      }
+      
       // sext maps (i1 1) to -1
       Expr one = mkTerm<mpz_class> (is_signed ? -1 : 1, m_efac);
       Expr zero = mkTerm<mpz_class> (0, m_efac);
@@ -347,7 +549,6 @@ namespace
           op0 = mk<ITE> (op0, one, zero);
       }
       
-      Expr act = GlobalConstraints ? trueE : m_activeLit;
       m_side.push_back (boolop::limp (act, mk<EQ> (lhs, op0)));
     }
     
@@ -512,14 +713,20 @@ namespace
       
       if (op0)
       {
-        Expr rhs = op::array::select (m_inMem, op0);
-        if (I.getType ()->isIntegerTy (1))
+        Expr rhs = memSelect (m_inMem, op0);
+        if (m_sem.isBv () && I.getType ()->isIntegerTy (1))
+          rhs = mk<NEQ> (rhs, m_sem.bvNum (0, m_sem.ptrWidth ()));
+        else if (m_sem.isBv ())
+          // -- memory words are as wide as pointers
+          rhs = bvWidth (I) <= m_sem.ptrWidth () ?
+            bvResize (rhs, m_sem.ptrWidth (), bvWidth (I)) : Expr (0);
+        else if (I.getType ()->isIntegerTy (1))
           // -- convert to Boolean
           rhs = mk<NEQ> (rhs, mkTerm (mpz_class(0), m_efac));
 
         Expr act = GlobalConstraints ? trueE : m_activeLit;
-        m_side.push_back (boolop::limp (act,
-                                        mk<EQ> (lhs, rhs)));
+        if (rhs) m_side.push_back (boolop::limp (act,
+                                                 mk<EQ> (lhs, rhs)));
       }
       
       m_inMem.reset ();
@@ -532,16 +739,24 @@ namespace
       Expr idx = lookup (*I.getPointerOperand ());
       Expr v = lookup (*I.getOperand (0));
       
-      if (v && I.getOperand (0)->getType ()->isIntegerTy (1))
+      const Value &v0 = *I.getOperand (0);
+      if (v && m_sem.isBv ())
+        v = v0.getType ()->isIntegerTy (1) ?
+          bvFromBool (v, m_sem.ptrWidth ()) :
+          bvWidth (v0) <= m_sem.ptrWidth () ?
+          bvResize (v, bvWidth (v0), m_sem.ptrWidth ()) : Expr (0);
+      else if (v && v0.getType ()->isIntegerTy (1))
         // -- convert to int
         v = boolop::lite (v, mkTerm (mpz_class (1), m_efac),
                           mkTerm (mpz_class (0), m_efac));
       
       Expr act = GlobalConstraints ? trueE : m_activeLit;
       if (idx && v)
-        m_side.push_back (boolop::limp (act,
-                                        mk<EQ> (m_outMem, 
-                                                op::array::store (m_inMem, idx, v))));
+      {
+        Expr st = memStore (m_inMem, idx, v);
+        m_side.push_back (boolop::limp (act, mk<EQ> (m_outMem, st)));
+        m_s.define (m_outMem, st);
+      }
       m_inMem.reset ();
       m_outMem.reset ();
     }
@@ -556,7 +771,15 @@ namespace
       
       Expr act = GlobalConstraints ? trueE : m_activeLit;
       Expr u = lookup (v0);
-      if (u) m_side.push_back (boolop::limp (act, mk<EQ> (lhs, u)));
+      if (!u) return;
+      if (m_sem.isBv ())
+      {
+        if (v0.getType ()->isIntegerTy (1) != I.getType ()->isIntegerTy (1)) return;
+        if (!I.getType ()->isIntegerTy (1))
+          u = bvResize (u, bvWidth (v0), bvWidth (I));
+      }
+      m_side.push_back (boolop::limp (act, mk<EQ> (lhs, u)));
+      if (I.getType ()->isPointerTy ()) m_s.define (lhs, u);
     }
     
     void initGlobals (const BasicBlock &BB)
@@ -618,9 +841,46 @@ namespace seahorn
     return this->SmallStepSymExec::errorFlag (BB);
   }
   
+  /// A block is cached only if its semantics cannot change later,
+  /// i.e., every function it calls is either external or already has
+  /// a summary
+  bool UfoSmallSymExec::isCacheable (const BasicBlock &bb)
+  {
+    const Function *PF = bb.getParent ();
+    for (const Instruction &inst : bb)
+    {
+      ImmutableCallSite CS (&inst);
+      if (!CS) continue;
+      const Function *f = CS.getCalledFunction ();
+      if (!f || f->isDeclaration ()) continue;
+      if (f == PF || !hasFunctionInfo (*f)) return false;
+    }
+    return true;
+  }
+  
   void UfoSmallSymExec::exec (SymStore &s, const BasicBlock &bb, ExprVector &side,
                               Expr act)
   {
+    if (TransitionCache && isCacheable (bb))
+      execTransition (s, bb, NULL, side, act);
+    else
+      execUncached (s, bb, NULL, side, act);
+  }
+  
+  void UfoSmallSymExec::execUncached (SymStore &s, const BasicBlock &bb,
+                                      const BasicBlock *from,
+                                      ExprVector &side, Expr act)
+  {
+    if (from)
+    {
+      // act is ignored since phi node only introduces a definition
+      SymExecPhiVisitor v(s, *this, side, *from);
+      v.setActiveLit (act);
+      v.visit (const_cast<BasicBlock&>(bb));
+      v.resetActiveLit ();
+      return;
+    }
+    
     SymExecVisitor v(s, *this, side);
     v.setActiveLit (act);
     v.visit (const_cast<BasicBlock&>(bb));
@@ -637,11 +897,9 @@ namespace seahorn
   void UfoSmallSymExec::execPhi (SymStore &s, const BasicBlock &bb, 
                                  const BasicBlock &from, ExprVector &side, Expr act)
   {
-    // act is ignored since phi node only introduces a definition
-    SymExecPhiVisitor v(s, *this, side, from);
-    v.setActiveLit (act);
-    v.visit (const_cast<BasicBlock&>(bb));
-    v.resetActiveLit ();
+    // -- phi-nodes do not call functions
+    if (TransitionCache) execTransition (s, bb, &from, side, act);
+    else execUncached (s, bb, &from, side, act);
   }
 
   Expr UfoSmallSymExec::ptrArith (SymStore &s, 
@@ -658,20 +916,57 @@ namespace seahorn
       {
         if (const ConstantInt *ci = dyn_cast<const ConstantInt> (ps [i]))
         {
-          Expr off = mkTerm<mpz_class> (fieldOff (st, ci->getZExtValue ()), m_efac);
-          res = mk<PLUS> (res, off);
+          unsigned off = fieldOff (st, ci->getZExtValue ());
+          res = isBv () ? mk<BADD> (res, bvNum (off, ptrWidth ())) :
+            mk<PLUS> (res, mkTerm<mpz_class> (off, m_efac));
         }
         else assert (0);
       }
       else if (const SequentialType *seqt = dyn_cast<const SequentialType> (ts [i]))
       {
-        Expr sz = mkTerm<mpz_class> (storageSize (seqt->getElementType ()), m_efac);
-        res = mk<PLUS> (res, mk<MULT> (lookup (s, *ps[i]), sz));
+        unsigned sz = storageSize (seqt->getElementType ());
+        if (const ConstantInt *ci = dyn_cast<const ConstantInt> (ps [i]))
+        {
+          // -- fold constant indices into a numeric offset
+          mpz_class off = toMpz (ci->getValue ()) * sz;
+          res = isBv () ? mk<BADD> (res, bvNum (off, ptrWidth ())) :
+            mk<PLUS> (res, mkTerm<mpz_class> (off, m_efac));
+          continue;
+        }
+        
+        Expr idx = lookup (s, *ps[i]);
+        if (!idx) return Expr (0);
+        if (isBv ())
+        {
+          // -- indices are signed and as wide as pointers
+          unsigned w = bvWidth (ps[i]->getType ());
+          if (w < ptrWidth ()) idx = bv::sext (idx, ptrWidth ());
+          else if (w > ptrWidth ()) idx = bv::extract (ptrWidth () - 1, 0, idx);
+          res = mk<BADD> (res, mk<BMUL> (idx, bvNum (sz, ptrWidth ())));
+        }
+        else
+          res = mk<PLUS> (res, mk<MULT> (idx, mkTerm<mpz_class> (sz, m_efac)));
       }
     }
     return res;
   }
   
+  bool UfoSmallSymExec::isBv () const {return BvSemantics;}
+  bool UfoSmallSymExec::simplifiesMem () const {return SimplifyMem;}
+  bool UfoSmallSymExec::hasGlobalConstraints () const {return GlobalConstraints;}
+  
+  unsigned UfoSmallSymExec::bvWidth (const llvm::Type *t)
+  {return m_td->getTypeSizeInBits (const_cast<Type*> (t));}
+  
+  Expr UfoSmallSymExec::bvNum (mpz_class k, unsigned width)
+  {
+    mpz_class m;
+    mpz_ui_pow_ui (m.get_mpz_t (), 2, width);
+    k %= m;
+    if (k < 0) k += m;
+    return bv::bvnum (k, width, m_efac);
+  }
+  
   unsigned UfoSmallSymExec::storageSize (const llvm::Type *t) 
   {return m_td->getTypeStoreSize (const_cast<Type*> (t));}
   
@@ -726,10 +1021,16 @@ namespace seahorn
         if (c->getType ()->isIntegerTy (1))
           return c->isOne () ? mk<TRUE> (m_efac) : mk<FALSE> (m_efac);
         mpz_class k = toMpz (c->getValue ());
+        if (isBv ()) return bvNum (k, c->getBitWidth ());
         return mkTerm<mpz_class> (k, m_efac);
       }
       else if (cv->isNullValue () || isa<ConstantPointerNull> (&I))
-        return mkTerm<mpz_class> (0, m_efac);
+      {
+        if (!isBv ()) return mkTerm<mpz_class> (0, m_efac);
+        const Type *ty = cv->getType ();
+        if (ty->isIntegerTy () || ty->isPointerTy ()) return bvNum (0, bvWidth (ty));
+        return Expr (0);
+      }
       else if (const ConstantExpr *ce = dyn_cast<const ConstantExpr> (&I))
       {
         // -- if this is a cast, and not into a Boolean, strip it
@@ -741,11 +1042,22 @@ namespace seahorn
         {
           if (const ConstantInt* val = dyn_cast<const ConstantInt>(ce->getOperand (0)))
           {
+            if (isBv ())
+            {
+              unsigned width = bvWidth (ce->getType ());
+              APInt k = ce->getOpcode () == Instruction::SExt ?
+                val->getValue ().sextOrTrunc (width) :
+                val->getValue ().zextOrTrunc (width);
+              return bvNum (toMpz (k), width);
+            }
             mpz_class k = toMpz (val->getValue ());
             return mkTerm<mpz_class> (k, m_efac);
           }
-          // -- strip cast
-          else return symb (*ce->getOperand (0));
+          // -- strip cast. Bit-vectors only when the width is preserved
+          else if (!isBv () || 
+                   bvWidth (ce->getType ()) == bvWidth (ce->getOperand (0)->getType ()))
+            return symb (*ce->getOperand (0));
+          else return Expr (0);
         }
       }
     }   
@@ -755,14 +1067,17 @@ namespace seahorn
     
     if (m_trackLvl >= MEM && isShadowMem (I))
     {
-      Expr intTy = sort::intTy (m_efac);
+      Expr intTy = isBv () ? 
+        bv::bvsort (ptrWidth (), m_efac) : sort::intTy (m_efac);
       Expr ty = sort::arrayTy (intTy, intTy);
       return bind::mkConst (v, ty);
     }
       
     if (isTracked (I))
-      return I.getType ()->isIntegerTy (1) ? 
-        bind::boolConst (v) : bind::intConst (v);
+    {
+      if (I.getType ()->isIntegerTy (1)) return bind::boolConst (v);
+      return isBv () ? bv::bvConst (v, bvWidth (I.getType ())) : bind::intConst (v);
+    }
     
     return Expr(0);
   }
@@ -970,6 +1285,131 @@ namespace seahorn
     
     
      
+  }
+  
+  void UfoMergeSymExec::execCpEdg (SymStore &s, const CpEdge &edge,
+                                   ExprVector &side)
+  {
+    ExprFactory &efac = m_sem.getExprFactory ();
+    Expr falseE = mk<FALSE> (efac);
+    
+    // -- the store at the exit of every executed block, and the
+    // -- condition under which the block is reached
+    DenseMap<const BasicBlock*, unsigned> index;
+    std::vector<SymStore> stores;
+    ExprVector reach;
+    stores.reserve (std::distance (edge.begin (), edge.end ()) + 1);
+    
+    // -- join values by the ITE they are equal to. Symbols merged from
+    // -- the same values on the same edges share a join value
+    ExprMap joins;
+    
+    const BasicBlock &target = edge.target ().bb ();
+    bool first = true;
+    for (auto it = edge.begin (), end = edge.end (); ; ++it)
+    {
+      bool last = it == end;
+      const BasicBlock &bb = last ? target : *it;
+      
+      if (first)
+      {
+        // -- the source is reached unconditionally
+        first = false;
+        stores.push_back (s);
+        m_sem.exec (stores.back (), bb, side, trueE);
+        reach.push_back (trueE);
+        index [&bb] = 0;
+        continue;
+      }
+      
+      // -- execute the edges from the predecessors on the cut-point
+      // -- edge. They precede bb in topological order
+      std::vector<SymStore> in;
+      ExprVector edges;
+      for (const BasicBlock *pred : seahorn::preds (bb))
+      {
+        auto pit = index.find (pred);
+        if (pit == index.end ()) continue;
+        
+        in.push_back (stores [pit->second]);
+        ExprVector guard;
+        m_sem.execBr (in.back (), *pred, bb, guard, trueE);
+        edges.push_back (boolop::land (reach [pit->second],
+                                       mknary<AND> (trueE, guard)));
+        // -- phi-nodes define fresh values, their definitions need no guard
+        m_sem.execPhi (in.back (), bb, *pred, side, trueE);
+      }
+      
+      if (in.empty ()) in.push_back (stores [0]);
+      SymStore res (in [0]);
+      
+      if (in.size () > 1)
+      {
+        ExprSet keys;
+        for (const SymStore &es : in)
+          for (auto &kv : es) keys.insert (kv.first);
+        
+        for (const Expr &key : keys)
+        {
+          // -- values on the edges that define the key. A key that is
+          // -- undefined on an edge is not read on it before it is written
+          ExprVector vals;
+          ExprVector conds;
+          for (unsigned i = 0; i < in.size (); ++i)
+            if (Expr v = in [i].at (key))
+            {
+              vals.push_back (v);
+              conds.push_back (edges [i]);
+            }
+          
+          bool same = true;
+          for (const Expr &v : vals) same = same && v == vals [0];
+          if (same)
+          {
+            if (res.at (key) != vals [0]) res.write (key, vals [0]);
+            continue;
+          }
+          
+          Expr ite = vals.back ();
+          for (unsigned i = vals.size () - 1; i > 0; --i)
+            ite = boolop::lite (conds [i - 1], vals [i - 1], ite);
+          
+          auto jit = joins.find (ite);
+          if (jit != joins.end ()) res.write (key, jit->second);
+          else
+          {
+            Expr v = res.havoc (key);
+            side.push_back (mk<EQ> (v, ite));
+            joins [ite] = v;
+          }
+        }
+      }
+      
+      Expr r = edges.empty () ? falseE : edges [0];
+      if (edges.size () > 1) r = mknary<OR> (falseE, edges);
+      
+      if (last)
+      {
+        // -- the target is always reached
+        side.push_back (r);
+        if (const TerminatorInst *term = bb.getTerminator ())
+          if (isa<UnreachableInst> (term)) m_sem.exec (res, bb, side, trueE);
+        s = res;
+        return;
+      }
+      
+      if (edges.size () > 1)
+      {
+        Expr bbV = res.havoc (m_sem.symb (bb));
+        side.push_back (mk<IFF> (bbV, r));
+        r = bbV;
+      }
+      
+      index [&bb] = stores.size ();
+      stores.push_back (res);
+      reach.push_back (r);
+      m_sem.exec (stores.back (), bb, side, r);
+    }
   }
     
     // 1. execute all basic blocks using small-step semantics in topological order
@@ -0,0 +1,55 @@
+#include "ufo/Smt/EZ3.hh"
+
+#define BOOST_TEST_MODULE bv_z3_test
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace expr;
+using namespace expr::op;
+using namespace ufo;
+
+BOOST_AUTO_TEST_CASE( bv_marshal_test )
+{
+  ExprFactory efac;
+  EZ3 z3 (efac);
+
+  Expr x = bv::bvConst (mkTerm<string> ("x", efac), 8);
+  Expr y = bv::bvConst (mkTerm<string> ("y", efac), 8);
+
+  // -- x * 2 == x << 1 holds at any width
+  Expr two = bv::bvnum (2, 8, efac);
+  Expr one = bv::bvnum (1, 8, efac);
+  ZSolver<EZ3> solver (z3);
+  solver.assertExpr (mk<NEQ> (mk<BMUL> (x, two), mk<BSHL> (x, one)));
+  BOOST_CHECK (bool (!solver.solve ()));
+
+  // -- sign-extension preserves signed order
+  solver.reset ();
+  solver.assertExpr (mk<NEQ> (mk<BSLT> (x, y),
+                              mk<BSLT> (bv::sext (x, 16), bv::sext (y, 16))));
+  BOOST_CHECK (bool (!solver.solve ()));
+
+  // -- zero-extension preserves unsigned order
+  solver.reset ();
+  solver.assertExpr (mk<NEQ> (mk<BULT> (x, y),
+                              mk<BULT> (bv::zext (x, 16), bv::zext (y, 16))));
+  BOOST_CHECK (bool (!solver.solve ()));
+
+  // -- the nibbles of x determine x
+  solver.reset ();
+  solver.assertExpr (mk<EQ> (bv::extract (3, 0, x), bv::bvnum (5, 4, efac)));
+  solver.assertExpr (mk<EQ> (bv::extract (7, 4, x), bv::bvnum (10, 4, efac)));
+  BOOST_CHECK (bool (solver.solve ()));
+  solver.push ();
+  solver.assertExpr (mk<NEQ> (x, bv::bvnum (0xA5, 8, efac)));
+  BOOST_CHECK (bool (!solver.solve ()));
+  solver.pop ();
+
+  // -- bit-vector terms survive a round-trip through z3
+  Expr e = mk<BSGE> (mk<BADD> (mk<BUREM> (x, y), bv::extract (7, 0, bv::zext (y, 16))),
+                     mk<BASHR> (mk<BXOR> (x, y), one));
+  Expr s = z3_simplify (z3, e);
+  solver.reset ();
+  solver.assertExpr (mk<NEQ> (e, s));
+  BOOST_CHECK (bool (!solver.solve ()));
+}
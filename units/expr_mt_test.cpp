@@ -0,0 +1,100 @@
+/** Stress test for the concurrent mode of ExprFactory */
+#include "ufo/Expr.hpp"
+
+#include <thread>
+
+#define BOOST_TEST_MODULE expr_mt_test
+#include <boost/test/unit_test.hpp>
+
+using namespace expr;
+
+namespace
+{
+  const unsigned THREADS = 8;
+  const unsigned N = 20000;
+
+  /** builds N terms. Thread t builds them in a different order */
+  void build (ExprFactory &efac, unsigned t, ExprVector &out)
+  {
+    out.resize (N);
+    for (unsigned k = 0; k < N; ++k)
+    {
+      unsigned i = (k * 7919 + t * 104729) % N;
+      Expr x = bind::intConst
+        (mkTerm<std::string> ("x" + std::to_string (i % 100), efac));
+      Expr y = bind::intConst
+        (mkTerm<std::string> ("y" + std::to_string (i % 37), efac));
+      Expr sum = mk<PLUS> (x, mkTerm<mpz_class> (i, efac));
+      // -- short-lived garbage that other threads may pick up again
+      Expr tmp = mk<MINUS> (sum, y);
+      out [i] = mk<AND> (mk<LT> (sum, y), mk<GEQ> (tmp, x));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE (concurrent_hash_consing)
+{
+  ExprFactory efac;
+  // -- some terms from before the concurrent phase
+  Expr x0 = bind::intConst (mkTerm<std::string> ("x0", efac));
+
+  efac.setConcurrent (true);
+
+  std::vector<ExprVector> res (THREADS);
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < THREADS; ++t)
+    workers.push_back (std::thread (build, std::ref (efac), t,
+                                    std::ref (res [t])));
+  for (unsigned t = 0; t < THREADS; ++t) workers [t].join ();
+
+  efac.setConcurrent (false);
+
+  for (unsigned t = 1; t < THREADS; ++t)
+    for (unsigned i = 0; i < N; ++i)
+      BOOST_REQUIRE (res [t][i].get () == res [0][i].get ());
+
+  // -- every thread holds one reference to each result
+  for (unsigned i = 0; i < N; ++i)
+    BOOST_REQUIRE_EQUAL (res [0][i]->use_count (), THREADS);
+
+  BOOST_CHECK (bind::intConst (mkTerm<std::string> ("x0", efac)) == x0);
+
+  // -- sequential mode still hash-conses with the same nodes
+  ExprVector seq;
+  build (efac, 0, seq);
+  for (unsigned i = 0; i < N; ++i)
+    BOOST_REQUIRE (seq [i].get () == res [0][i].get ());
+}
+
+BOOST_AUTO_TEST_CASE (concurrent_memos)
+{
+  ExprFactory efac;
+  efac.setConcurrent (true);
+
+  // -- each thread registers and unregisters memos, as the SymStores
+  // -- of hornification workers do
+  std::vector<std::thread> workers;
+  for (unsigned t = 0; t < THREADS; ++t)
+    workers.push_back (std::thread ([&efac, t] ()
+      {
+        for (unsigned k = 0; k < 1000; ++k)
+        {
+          DagVisitMemo memo (efac);
+          Expr x = bind::intConst
+            (mkTerm<std::string> ("m" + std::to_string (t * 1000 + k), efac));
+          memo.insert (&*x, x);
+          // -- a memo that holds its keys is not registered
+          DagVisitMemo held (efac, true);
+          held.insert (&*x, mk<PLUS> (x, x));
+        }
+      }));
+  for (auto &w : workers) w.join ();
+
+  efac.setConcurrent (false);
+
+  // -- all memos are gone: reclaiming nodes touches no dangling cache
+  Expr y = bind::intConst (mkTerm<std::string> ("y", efac));
+  DagVisitMemo memo (efac);
+  memo.insert (&*y, mk<PLUS> (y, y));
+  BOOST_CHECK_EQUAL (memo.size (), 1);
+}
@@ -0,0 +1,54 @@
+#include "ufo/ExprNorm.hpp"
+
+#define BOOST_TEST_MODULE expr_norm_test
+#include <boost/test/unit_test.hpp>
+
+using namespace expr;
+
+BOOST_AUTO_TEST_CASE (norm_test)
+{
+  ExprFactory efac;
+
+  Expr x = bind::intConst (mkTerm<std::string> ("x", efac));
+  Expr y = bind::intConst (mkTerm<std::string> ("y", efac));
+  Expr p = bind::boolConst (mkTerm<std::string> ("p", efac));
+  Expr q = bind::boolConst (mkTerm<std::string> ("q", efac));
+  Expr t = mk<TRUE> (efac);
+  Expr f = mk<FALSE> (efac);
+  Expr one = mkTerm<mpz_class> (1, efac);
+  Expr two = mkTerm<mpz_class> (2, efac);
+
+  // -- flattening, neutral elements, duplicates and argument order
+  Expr pq = norm::mk<AND> (p, q);
+  BOOST_CHECK (norm::mk<AND> (q, p) == pq);
+  BOOST_CHECK (norm::mk<AND> (mk<AND> (t, q), mk<AND> (p, q)) == pq);
+  BOOST_CHECK (norm::mk<AND> (p, mk<NEG> (p)) == f);
+  BOOST_CHECK (norm::mk<OR> (p, mk<OR> (f, q)) == norm::mk<OR> (q, p));
+  BOOST_CHECK (norm::mk<OR> (p, t) == t);
+
+  ExprVector side;
+  BOOST_CHECK (norm::mknary<AND> (t, side) == t);
+  side.push_back (t);
+  side.push_back (p);
+  side.push_back (mk<AND> (q, t));
+  BOOST_CHECK (norm::mknary<AND> (t, side) == pq);
+
+  // -- numerals
+  Expr three = mkTerm<mpz_class> (3, efac);
+  Expr sum = norm::mk<PLUS> (mk<PLUS> (one, x), mk<PLUS> (two, y));
+  BOOST_CHECK_EQUAL (sum->arity (), 3);
+  BOOST_CHECK (sum == norm::mk<PLUS> (mk<PLUS> (y, three), x));
+  BOOST_CHECK (norm::mk<PLUS> (one, mkTerm<mpz_class> (-1, efac)) ==
+               mkTerm<mpz_class> (0, efac));
+  BOOST_CHECK (norm::mk<MULT> (two, mk<MULT> (x, two)) ==
+               norm::mk<MULT> (mkTerm<mpz_class> (4, efac), x));
+  BOOST_CHECK (norm::mk<MINUS> (two, one) == one);
+  BOOST_CHECK (norm::mk<LT> (one, two) == t);
+  BOOST_CHECK (norm::mk<EQ> (x, x) == t);
+  BOOST_CHECK (norm::mk<EQ> (x, y) == mk<EQ> (x, y));
+
+  // -- deep chains are flattened without recursion
+  Expr c = p;
+  for (unsigned i = 0; i < 1000000; ++i) c = mk<AND> (c, q);
+  BOOST_CHECK (norm::mk<AND> (c, p) == pq);
+}
@@ -0,0 +1,77 @@
+/** Benchmark for the unique table of ExprFactory.
+
+    Compiled twice: once with the default open-addressing table and
+    once with UNORDERED_SET_UNIQUE_TABLE (one hash set per operator
+    type). Compare the times reported by the two executables.
+ */
+#include "ufo/Expr.hpp"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+
+#define BOOST_TEST_MODULE expr_unique_bench
+#include <boost/test/unit_test.hpp>
+
+using namespace expr;
+
+namespace
+{
+  const unsigned N = 200000;
+
+  double elapsed (std::chrono::steady_clock::time_point start)
+  {
+    return std::chrono::duration<double>
+      (std::chrono::steady_clock::now () - start).count ();
+  }
+
+  /** builds N terms over the variables vars */
+  void build (ExprFactory &efac, const ExprVector &vars, ExprVector &out)
+  {
+    for (unsigned i = 0; i + 1 < vars.size (); ++i)
+    {
+      Expr sum = mk<PLUS> (vars [i], vars [i + 1]);
+      Expr prod = mk<MULT> (sum, mkTerm<mpz_class> (i, efac));
+      out.push_back (mk<ITE> (mk<LT> (prod, vars [i]), sum, prod));
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE (unique_table_bench)
+{
+  ExprFactory efac;
+
+  ExprVector vars;
+  for (unsigned i = 0; i < N; ++i)
+    vars.push_back (bind::intConst
+                    (mkTerm<std::string> ("x" + std::to_string (i), efac)));
+
+  auto start = std::chrono::steady_clock::now ();
+  ExprVector first;
+  build (efac, vars, first);
+  double tMiss = elapsed (start);
+
+  start = std::chrono::steady_clock::now ();
+  ExprVector second;
+  build (efac, vars, second);
+  double tHit = elapsed (start);
+
+  // -- hash-consing must return the very same nodes
+  BOOST_REQUIRE_EQUAL (first.size (), second.size ());
+  for (unsigned i = 0; i < first.size (); ++i)
+    BOOST_REQUIRE (first [i].get () == second [i].get ());
+
+  start = std::chrono::steady_clock::now ();
+  first.clear ();
+  second.clear ();
+  double tFree = elapsed (start);
+
+  llvm::errs ()
+#ifdef UNORDERED_SET_UNIQUE_TABLE
+    << "unordered_set unique table\n"
+#else
+    << "open addressing unique table\n"
+#endif
+    << "  build (miss): " << tMiss << "s\n"
+    << "  build (hit):  " << tHit << "s\n"
+    << "  release:      " << tFree << "s\n";
+}
@@ -0,0 +1,280 @@
+/** Benchmark for visiting and destroying deep expressions.
+
+    visit, dagVisit, replace and the destruction of nodes use an
+    explicit stack. They are compared against a copy of the former
+    recursive visit, which runs in a thread with a large stack, and
+    are then run on chains that are too deep for the recursive one.
+
+    Also compares many small dagVisit calls against one DagVisitMemo
+    kept across the calls.
+ */
+#include "ufo/Expr.hpp"
+#include "llvm/Support/raw_ostream.h"
+
+#include <boost/make_shared.hpp>
+#include <chrono>
+#include <pthread.h>
+
+#define BOOST_TEST_MODULE expr_visit_bench
+#include <boost/test/unit_test.hpp>
+
+using namespace expr;
+
+namespace
+{
+  /** depth of the chains compared against the recursive visit */
+  const unsigned SHALLOW = 100000;
+  /** depth of the chains visited by the iterative versions only */
+  const unsigned DEEP = 1000000;
+
+  double elapsed (std::chrono::steady_clock::time_point start)
+  {
+    return std::chrono::duration<double>
+      (std::chrono::steady_clock::now () - start).count ();
+  }
+
+  /** x_0 && y_0 -> (x_1 && y_1 -> ... ) */
+  Expr chain (unsigned depth, const ExprVector &x, const ExprVector &y)
+  {
+    Expr res = mk<TRUE> (x [0]->efac ());
+    for (unsigned i = depth; i > 0; --i)
+      res = mk<IMPL> (mk<AND> (x [(i - 1) % x.size ()],
+                               y [(i - 1) % y.size ()]), res);
+    return res;
+  }
+
+  /** Replaces the x variables by the y variables */
+  struct Swap
+  {
+    const ExprMap &map;
+    Swap (const ExprMap &m) : map (m) {}
+    VisitAction operator() (Expr exp) const
+    {
+      ExprMap::const_iterator it = map.find (exp);
+      return it == map.end () ? VisitAction::doKids () :
+        VisitAction::changeTo (it->second);
+    }
+  };
+
+  /** Conjoins a literal to the result of a rewrite */
+  struct Strengthen
+  {
+    Expr lit;
+    Strengthen (Expr l) : lit (l) {}
+    Expr operator() (Expr exp) const { return mk<AND> (exp, lit); }
+  };
+
+  /** Strengthens every disjunction through a rewriter that only the
+      returned action owns */
+  struct StrengthenOr
+  {
+    Expr lit;
+    StrengthenOr (Expr l) : lit (l) {}
+    VisitAction operator() (Expr exp) const
+    {
+      return isOpX<OR> (exp) ?
+        VisitAction::changeDoKidsRewrite
+        (exp, boost::make_shared<Strengthen> (lit)) :
+        VisitAction::doKids ();
+    }
+  };
+
+  /** the recursive DAG visit that visit () replaces */
+  template <typename ExprVisitor>
+  Expr recVisit (ExprVisitor &v, Expr expr, DagVisitCache &cache)
+  {
+    if (expr->use_count () > 1)
+    {
+      DagVisitCache::const_iterator cit = cache.find (&*expr);
+      if (cit != cache.end ()) return cit->second;
+    }
+
+    VisitAction va = v(expr);
+    Expr res;
+
+    if (va.isSkipKids ())
+      res = expr;
+    else if (va.isChangeTo ())
+      res = va.getExpr ();
+    else
+    {
+      res = va.isChangeDoKidsRewrite () ? va.getExpr () : expr;
+      if (res->arity () > 0)
+      {
+        bool changed = false;
+        std::vector<Expr> kids;
+        for (ENode::args_iterator b = res->args_begin (),
+               e = res->args_end (); b != e; ++b)
+        {
+          Expr k = recVisit (v, *b, cache);
+          kids.push_back (k);
+          changed  = (changed || k.get () != *b);
+        }
+
+        if (changed)
+          res = res->getFactory ().mkNary (res->op (),
+                                           kids.begin (), kids.end ());
+      }
+      res = va.rewrite (res);
+    }
+
+    if (expr->use_count () > 1)
+    {
+      expr->Ref ();
+      cache[&*expr] = res;
+    }
+    return res;
+  }
+
+  struct RecJob
+  {
+    Swap *swap;
+    Expr in;
+    Expr out;
+  };
+
+  void *runRecVisit (void *p)
+  {
+    RecJob &job = *static_cast<RecJob*> (p);
+    DagVisitCache cache;
+    job.out = recVisit (*job.swap, job.in, cache);
+    clearDagVisitCache (cache);
+    return NULL;
+  }
+
+  /** runs the recursive visit in a thread with a 1GB stack */
+  Expr recReplace (Swap &swap, Expr e)
+  {
+    RecJob job;
+    job.swap = &swap;
+    job.in = e;
+
+    pthread_attr_t attr;
+    pthread_attr_init (&attr);
+    pthread_attr_setstacksize (&attr, 1024u * 1024u * 1024u);
+    pthread_t t;
+    BOOST_REQUIRE (pthread_create (&t, &attr, runRecVisit, &job) == 0);
+    pthread_join (t, NULL);
+    pthread_attr_destroy (&attr);
+    return job.out;
+  }
+
+  struct Fixture
+  {
+    ExprFactory efac;
+    ExprVector x;
+    ExprVector y;
+    ExprMap map;
+
+    Fixture ()
+    {
+      for (unsigned i = 0; i < 64; ++i)
+      {
+        x.push_back (bind::boolConst
+                     (mkTerm<std::string> ("x" + std::to_string (i), efac)));
+        y.push_back (bind::boolConst
+                     (mkTerm<std::string> ("y" + std::to_string (i), efac)));
+        map [x.back ()] = y.back ();
+      }
+    }
+  };
+}
+
+BOOST_FIXTURE_TEST_CASE (recursive_vs_iterative, Fixture)
+{
+  Expr e = chain (SHALLOW, x, x);
+  Swap swap (map);
+
+  auto start = std::chrono::steady_clock::now ();
+  Expr rec = recReplace (swap, e);
+  double tRec = elapsed (start);
+
+  // -- drop the result so that the iterative visit builds it again
+  rec.reset ();
+
+  start = std::chrono::steady_clock::now ();
+  Expr it = replace (e, map);
+  double tIt = elapsed (start);
+
+  BOOST_CHECK (it == chain (SHALLOW, y, y));
+
+  llvm::errs () << "replace on a chain of depth " << SHALLOW << "\n"
+                << "  recursive: " << tRec << "s\n"
+                << "  iterative: " << tIt << "s\n";
+}
+
+BOOST_FIXTURE_TEST_CASE (deep_chains, Fixture)
+{
+  auto start = std::chrono::steady_clock::now ();
+  Expr e = chain (DEEP, x, x);
+  double tBuild = elapsed (start);
+
+  start = std::chrono::steady_clock::now ();
+  Expr r = replace (e, map);
+  double tReplace = elapsed (start);
+
+  Expr expected = chain (DEEP, y, y);
+  BOOST_CHECK (r == expected);
+  expected.reset ();
+
+  Swap swap (map);
+  start = std::chrono::steady_clock::now ();
+  Expr t = visit (swap, e);
+  double tVisit = elapsed (start);
+  BOOST_CHECK (t == r);
+  t.reset ();
+
+  start = std::chrono::steady_clock::now ();
+  e.reset ();
+  r.reset ();
+  double tFree = elapsed (start);
+
+  llvm::errs () << "chain of depth " << DEEP << "\n"
+                << "  build:   " << tBuild << "s\n"
+                << "  replace: " << tReplace << "s\n"
+                << "  visit:   " << tVisit << "s\n"
+                << "  release: " << tFree << "s\n";
+}
+
+BOOST_FIXTURE_TEST_CASE (persistent_memo, Fixture)
+{
+  ExprVector terms;
+  for (unsigned i = 0; i < 200000; ++i)
+  {
+    Expr a = x [i % x.size ()];
+    Expr b = x [(i / x.size ()) % x.size ()];
+    terms.push_back (mk<AND> (mk<OR> (a, b), mk<IMPL> (b, a)));
+  }
+
+  Swap swap (map);
+  ExprVector fresh;
+  auto start = std::chrono::steady_clock::now ();
+  for (const Expr &t : terms) fresh.push_back (dagVisit (swap, t));
+  double tDag = elapsed (start);
+
+  MemoDagVisit<Swap> mv (swap, efac);
+  ExprVector memo;
+  start = std::chrono::steady_clock::now ();
+  for (const Expr &t : terms) memo.push_back (mv (t));
+  double tMemo = elapsed (start);
+
+  BOOST_CHECK (fresh == memo);
+
+  // -- entries of reclaimed keys are dropped, only the variables
+  // -- are left
+  terms.clear ();
+  BOOST_CHECK_EQUAL (mv.m_memo.size (), x.size ());
+
+  llvm::errs () << "200000 small visits\n"
+                << "  dagVisit: " << tDag << "s\n"
+                << "  memo:     " << tMemo << "s\n";
+}
+
+BOOST_FIXTURE_TEST_CASE (shared_rewriter, Fixture)
+{
+  Expr e = mk<IMPL> (mk<OR> (x [0], y [0]), mk<OR> (x [1], y [1]));
+  StrengthenOr s (x [2]);
+  BOOST_CHECK (dagVisit (s, e) ==
+               mk<IMPL> (mk<AND> (mk<OR> (x [0], y [0]), x [2]),
+                         mk<AND> (mk<OR> (x [1], y [1]), x [2])));
+}
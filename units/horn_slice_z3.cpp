@@ -0,0 +1,128 @@
+#include "seahorn/HornClauseDBTransf.hh"
+#include "ufo/Smt/EZ3.hh"
+
+#define BOOST_TEST_MODULE horn_slice_z3_test
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace expr;
+using namespace seahorn;
+
+namespace
+{
+  /// true if the query of db is reachable
+  boost::tribool reach (const HornClauseDB &db, ufo::EZ3 &z3)
+  {
+    ufo::ZFixedPoint<ufo::EZ3> fp (z3);
+    ufo::ZParams<ufo::EZ3> params (z3);
+    params.set (":engine", "spacer");
+    params.set (":xform.slice", false);
+    fp.set (params);
+    db.loadZFixedPoint (fp);
+    return fp.query ();
+  }
+
+  struct Fixture
+  {
+    ExprFactory efac;
+    ufo::EZ3 z3;
+    Expr iTy;
+    Expr bTy;
+    Expr x;
+    Expr y;
+    Expr zero;
+    Expr one;
+    Expr Q;
+    HornClauseDB db;
+
+    Fixture () : z3 (efac), db (efac)
+    {
+      iTy = mk<INT_TY> (efac);
+      bTy = mk<BOOL_TY> (efac);
+      x = bind::intConst (mkTerm<string> ("x", efac));
+      y = bind::intConst (mkTerm<string> ("y", efac));
+      zero = mkTerm (mpz_class (0), efac);
+      one = mkTerm (mpz_class (1), efac);
+      ExprVector ty {bTy};
+      Q = bind::fdecl (mkTerm<string> ("Q", efac), ty);
+      db.registerRelation (Q);
+      db.addQuery (bind::fapp (Q));
+    }
+  };
+}
+
+BOOST_FIXTURE_TEST_CASE (defined_argument, Fixture)
+{
+  // -- x = 0 -> P(x);  P(x) & x = 5 -> Q;  Q -> false
+  ExprVector ty {iTy, bTy};
+  Expr P = bind::fdecl (mkTerm<string> ("P", efac), ty);
+  db.registerRelation (P);
+  ExprVector vars {x};
+  db.addRule (vars, mk<IMPL> (mk<EQ> (x, zero), bind::fapp (P, x)));
+  db.addRule (vars, mk<IMPL> (mk<AND> (bind::fapp (P, x),
+                                       mk<EQ> (x, mkTerm (mpz_class (5), efac))),
+                              bind::fapp (Q)));
+  BOOST_CHECK (bool (!reach (db, z3)));
+
+  SliceMap sliced;
+  sliceHornClauseDB (db, sliced);
+  BOOST_CHECK (sliced.empty ());
+  BOOST_CHECK (bool (!reach (db, z3)));
+}
+
+BOOST_FIXTURE_TEST_CASE (related_arguments, Fixture)
+{
+  // -- x = 0 & y = 1 -> P(x, y);  P(x, y) & x = y -> Q;  Q -> false
+  ExprVector ty {iTy, iTy, bTy};
+  Expr P = bind::fdecl (mkTerm<string> ("P", efac), ty);
+  db.registerRelation (P);
+  ExprVector vars {x, y};
+  db.addRule (vars, mk<IMPL> (mk<AND> (mk<EQ> (x, zero), mk<EQ> (y, one)),
+                              bind::fapp (P, x, y)));
+  db.addRule (vars, mk<IMPL> (mk<AND> (bind::fapp (P, x, y), mk<EQ> (x, y)),
+                              bind::fapp (Q)));
+  BOOST_CHECK (bool (!reach (db, z3)));
+
+  SliceMap sliced;
+  sliceHornClauseDB (db, sliced);
+  BOOST_CHECK (sliced.empty ());
+  BOOST_CHECK (bool (!reach (db, z3)));
+}
+
+BOOST_FIXTURE_TEST_CASE (free_argument, Fixture)
+{
+  // -- x = 0 -> P(x, y);  P(x, y) & x = 5 -> Q;  Q -> false
+  // -- the second argument of P is sliced away
+  ExprVector ty {iTy, iTy, bTy};
+  Expr P = bind::fdecl (mkTerm<string> ("P", efac), ty);
+  db.registerRelation (P);
+  ExprVector vars {x, y};
+  db.addRule (vars, mk<IMPL> (mk<EQ> (x, zero), bind::fapp (P, x, y)));
+  db.addRule (vars, mk<IMPL> (mk<AND> (bind::fapp (P, x, y),
+                                       mk<EQ> (x, mkTerm (mpz_class (5), efac))),
+                              bind::fapp (Q)));
+
+  SliceMap sliced;
+  sliceHornClauseDB (db, sliced);
+  BOOST_REQUIRE_EQUAL (sliced.size (), 1);
+  BOOST_CHECK (sliced [P].kept == std::vector<unsigned> {0});
+  BOOST_CHECK (bool (!reach (db, z3)));
+}
+
+BOOST_FIXTURE_TEST_CASE (remove_rules, Fixture)
+{
+  // -- x = 0 -> false;  y = 1 -> Q
+  ExprVector xs {x};
+  ExprVector ys {y};
+  HornRule err (xs, mk<IMPL> (mk<EQ> (x, zero), mk<FALSE> (efac)));
+  db.addRule (err);
+  db.addRule (ys, mk<IMPL> (mk<EQ> (y, one), bind::fapp (Q)));
+  BOOST_CHECK_EQUAL (db.numRules (), 2);
+  BOOST_CHECK_EQUAL (db.getVars ().size (), 2);
+
+  // -- a rule whose head is not an application is found as well
+  db.removeRule (err);
+  BOOST_CHECK_EQUAL (db.numRules (), 1);
+  BOOST_CHECK_EQUAL (db.getVars ().size (), 1);
+  BOOST_CHECK (db.getVars ().count (y));
+}
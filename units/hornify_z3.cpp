@@ -0,0 +1,259 @@
+/** Runs HornifyModule and HornSolver on small programs and compares
+    the verdicts and the clauses of the encodings.
+
+    Options of the encoding are set by name between runs, as if they
+    were given on the command line.
+ */
+#include "seahorn/HornifyModule.hh"
+#include "seahorn/HornSolver.hh"
+
+#include "llvm/PassManager.h"
+#include "llvm/InitializePasses.h"
+#include "llvm/AsmParser/Parser.h"
+#include "llvm/ADT/StringMap.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/SourceMgr.h"
+
+#define BOOST_TEST_MODULE hornify_z3
+#include <boost/test/unit_test.hpp>
+
+using namespace llvm;
+
+namespace
+{
+  /** x > 0; i = x; while (i < 100) i++; assert (i > bound) */
+  std::string program (unsigned bound)
+  {
+    return
+      "target datalayout = \"e-m:e-i64:64-f80:128-n8:16:32:64-S128\"\n"
+      "declare void @verifier.assume(i1)\n"
+      "declare void @verifier.error() #0\n"
+      "declare i32 @nd()\n"
+      "define i32 @main() {\n"
+      "entry:\n"
+      "  %x = call i32 @nd()\n"
+      "  %c = icmp sgt i32 %x, 0\n"
+      "  call void @verifier.assume(i1 %c)\n"
+      "  br label %loop\n"
+      "loop:\n"
+      "  %i = phi i32 [ %x, %entry ], [ %i.next, %body ]\n"
+      "  %d = icmp slt i32 %i, 100\n"
+      "  br i1 %d, label %body, label %check\n"
+      "body:\n"
+      "  %i.next = add nsw i32 %i, 1\n"
+      "  br label %loop\n"
+      "check:\n"
+      "  %ok = icmp sgt i32 %i, " + std::to_string (bound) + "\n"
+      "  br i1 %ok, label %exit, label %err\n"
+      "err:\n"
+      "  call void @verifier.error()\n"
+      "  unreachable\n"
+      "exit:\n"
+      "  ret i32 0\n"
+      "}\n"
+      "attributes #0 = { noreturn readnone }\n";
+  }
+
+  /** i = 0; while (i < 10) if (nd () > 0) i++; else i += 2;
+      assert (i >= bound) */
+  std::string diamond (unsigned bound)
+  {
+    return
+      "target datalayout = \"e-m:e-i64:64-f80:128-n8:16:32:64-S128\"\n"
+      "declare void @verifier.error() #0\n"
+      "declare i32 @nd()\n"
+      "define i32 @main() {\n"
+      "entry:\n"
+      "  br label %loop\n"
+      "loop:\n"
+      "  %i = phi i32 [ 0, %entry ], [ %i.next, %join ]\n"
+      "  %d = icmp slt i32 %i, 10\n"
+      "  br i1 %d, label %body, label %check\n"
+      "body:\n"
+      "  %p = call i32 @nd()\n"
+      "  %c = icmp sgt i32 %p, 0\n"
+      "  br i1 %c, label %then, label %else\n"
+      "then:\n"
+      "  %a = add nsw i32 %i, 1\n"
+      "  br label %join\n"
+      "else:\n"
+      "  %b = add nsw i32 %i, 2\n"
+      "  br label %join\n"
+      "join:\n"
+      "  %i.next = phi i32 [ %a, %then ], [ %b, %else ]\n"
+      "  br label %loop\n"
+      "check:\n"
+      "  %ok = icmp sge i32 %i, " + std::to_string (bound) + "\n"
+      "  br i1 %ok, label %exit, label %err\n"
+      "err:\n"
+      "  call void @verifier.error()\n"
+      "  unreachable\n"
+      "exit:\n"
+      "  ret i32 0\n"
+      "}\n"
+      "attributes #0 = { noreturn readnone }\n";
+  }
+
+  /** main calls n functions that sum the numbers from a to 10 */
+  std::string callees (unsigned n)
+  {
+    std::string ir =
+      "target datalayout = \"e-m:e-i64:64-f80:128-n8:16:32:64-S128\"\n"
+      "declare void @verifier.error() #0\n"
+      "declare i32 @nd()\n";
+    std::string calls;
+    for (unsigned k = 0; k < n; ++k)
+    {
+      std::string f = "@f" + std::to_string (k);
+      std::string r = "%r" + std::to_string (k);
+      ir +=
+        "define i32 " + f + "(i32 %a) {\n"
+        "entry:\n"
+        "  br label %loop\n"
+        "loop:\n"
+        "  %i = phi i32 [ %a, %entry ], [ %i.next, %body ]\n"
+        "  %s = phi i32 [ 0, %entry ], [ %s.next, %body ]\n"
+        "  %d = icmp slt i32 %i, 10\n"
+        "  br i1 %d, label %body, label %exit\n"
+        "body:\n"
+        "  %i.next = add nsw i32 %i, 1\n"
+        "  %s.next = add nsw i32 %s, %i\n"
+        "  br label %loop\n"
+        "exit:\n"
+        "  ret i32 %s\n"
+        "}\n";
+      calls +=
+        "  " + r + " = call i32 " + f + "(i32 %x)\n"
+        "  %c" + std::to_string (k) + " = icmp sge i32 " + r + ", 0\n";
+    }
+    ir +=
+      "define i32 @main() {\n"
+      "entry:\n"
+      "  %x = call i32 @nd()\n" + calls +
+      "  br i1 %c0, label %exit, label %err\n"
+      "err:\n"
+      "  call void @verifier.error()\n"
+      "  unreachable\n"
+      "exit:\n"
+      "  ret i32 0\n"
+      "}\n"
+      "attributes #0 = { noreturn readnone }\n";
+    return ir;
+  }
+
+  void setOption (const char *name, const char *value)
+  {
+    StringMap<cl::Option*> opts;
+    cl::getRegisteredOptions (opts);
+    cl::Option *o = opts.lookup (name);
+    BOOST_REQUIRE (o);
+    // -- an option is set once per run
+    o->setNumOccurrencesFlag (cl::ZeroOrMore);
+    BOOST_REQUIRE (!o->addOccurrence (1, name, value));
+  }
+
+  /** verdict of HornSolver on ir: true if the error is reachable */
+  boost::tribool solve (const std::string &ir)
+  {
+    LLVMContext ctx;
+    SMDiagnostic err;
+    std::unique_ptr<Module> m = parseAssemblyString (ir, err, ctx);
+    BOOST_REQUIRE (m);
+
+    PassManager pm;
+    pm.add (new DataLayoutPass ());
+    seahorn::HornSolver *solver = new seahorn::HornSolver ();
+    pm.add (solver);
+    pm.run (*m);
+    return solver->getResult ();
+  }
+
+  /** the clauses of HornifyModule on ir, as printed by HornClauseDB,
+      and optionally the number of its relations */
+  std::string encode (const std::string &ir, size_t *numRels = nullptr)
+  {
+    LLVMContext ctx;
+    SMDiagnostic err;
+    std::unique_ptr<Module> m = parseAssemblyString (ir, err, ctx);
+    BOOST_REQUIRE (m);
+
+    PassManager pm;
+    pm.add (new DataLayoutPass ());
+    seahorn::HornifyModule *hm = new seahorn::HornifyModule ();
+    pm.add (hm);
+    pm.run (*m);
+
+    if (numRels) *numRels = hm->getHornClauseDB ().getRelations ().size ();
+    std::string res;
+    raw_string_ostream os (res);
+    os << hm->getHornClauseDB ();
+    return os.str ();
+  }
+
+  struct InitPasses
+  {
+    InitPasses ()
+    {
+      PassRegistry &r = *PassRegistry::getPassRegistry ();
+      initializeAnalysis (r);
+      initializeIPA (r);
+    }
+  };
+}
+
+BOOST_GLOBAL_FIXTURE (InitPasses);
+
+BOOST_AUTO_TEST_CASE (medium_step)
+{
+  const char *steps [] = {"small", "medium"};
+  for (const char *step : steps)
+  {
+    BOOST_TEST_MESSAGE ("-horn-step=" << step);
+    setOption ("horn-step", step);
+    BOOST_CHECK (bool (!solve (program (0))));
+    BOOST_CHECK (bool (solve (program (100))));
+  }
+  setOption ("horn-step", "small");
+}
+
+BOOST_AUTO_TEST_CASE (medium_diamond)
+{
+  size_t rels [2];
+  const char *steps [] = {"small", "medium"};
+  for (unsigned i = 0; i < 2; ++i)
+  {
+    BOOST_TEST_MESSAGE ("-horn-step=" << steps [i]);
+    setOption ("horn-step", steps [i]);
+    BOOST_CHECK (bool (!solve (diamond (10))));
+    BOOST_CHECK (bool (solve (diamond (11))));
+    encode (diamond (10), &rels [i]);
+  }
+  setOption ("horn-step", "small");
+
+  // -- only entry, loop and exit have a predicate. The join of the
+  // -- diamond would have one if the arms were not merged
+  BOOST_CHECK_EQUAL (rels [0] - rels [1], 6);
+}
+
+BOOST_AUTO_TEST_CASE (parallel_clauses)
+{
+  // -- the callees are encoded by concurrent workers, which create
+  // -- their nodes in a different order in every run
+  std::string ir = callees (8);
+  setOption ("horn-inter-proc", "true");
+  const char *steps [] = {"small", "medium"};
+  for (const char *step : steps)
+  {
+    BOOST_TEST_MESSAGE ("-horn-step=" << step);
+    setOption ("horn-step", step);
+    setOption ("horn-threads", "1");
+    std::string seq = encode (ir);
+    setOption ("horn-threads", "4");
+    for (unsigned i = 0; i < 4; ++i) BOOST_CHECK (encode (ir) == seq);
+  }
+  setOption ("horn-threads", "1");
+  setOption ("horn-step", "small");
+  setOption ("horn-inter-proc", "false");
+}
@@ -0,0 +1,67 @@
+#include "seahorn/InvariantStore.hh"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/Support/FileSystem.h"
+
+#define BOOST_TEST_MODULE inv_store_z3_test
+#include <boost/test/unit_test.hpp>
+
+using namespace std;
+using namespace expr;
+using namespace seahorn;
+
+BOOST_AUTO_TEST_CASE( validate_test )
+{
+  ExprFactory efac;
+  ufo::EZ3 z3 (efac);
+
+  Expr iTy = mk<INT_TY> (efac);
+  ExprVector ty {iTy, mk<BOOL_TY> (efac)};
+  Expr P = bind::fdecl (mkTerm<string> ("P", efac), ty);
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  Expr y = bind::intConst (mkTerm<string> ("y", efac));
+  Expr zero = mkTerm (mpz_class (0), efac);
+  Expr one = mkTerm (mpz_class (1), efac);
+
+  // -- x = 0 -> P(x);  P(x) & y = x + 1 -> P(y)
+  HornClauseDB db (efac);
+  db.registerRelation (P);
+  ExprVector vars {x, y};
+  db.addRule (vars, mk<IMPL> (mk<EQ> (x, zero), bind::fapp (P, x)));
+  db.addRule (vars, mk<IMPL> (mk<AND> (bind::fapp (P, x),
+                                       mk<EQ> (y, mk<PLUS> (x, one))),
+                              bind::fapp (P, y)));
+
+  Expr b0 = bind::bvar (0, iTy);
+  Expr pos = mk<GEQ> (b0, zero);
+  std::map<Expr, ExprVector> invs;
+  invs [P] = {pos, mk<LEQ> (b0, mkTerm (mpz_class (5), efac)), mk<GEQ> (b0, one)};
+  validateInvariants (db, z3, invs);
+
+  // -- only x >= 0 is inductive
+  BOOST_CHECK_EQUAL (invs [P].size (), 1);
+  BOOST_CHECK (invs [P][0] == pos);
+}
+
+BOOST_AUTO_TEST_CASE( store_test )
+{
+  ExprFactory efac;
+  llvm::LLVMContext ctx;
+  llvm::Module m ("m", ctx);
+  ExprValueResolver resolver (m);
+
+  Expr x = bind::intConst (mkTerm<string> ("x", efac));
+  Expr inv = mk<GEQ> (x, mkTerm (mpz_class (0), efac));
+
+  InvariantStore store;
+  store.set ("a", {inv});
+  store.set ("b", {});
+  BOOST_CHECK (store.save ("inv_store_z3.st"));
+
+  InvariantStore loaded;
+  BOOST_CHECK (loaded.load ("inv_store_z3.st", efac, resolver));
+  // -- blocks without lemmas are not stored
+  BOOST_CHECK_EQUAL (loaded.size (), 1);
+  BOOST_REQUIRE (loaded.get ("a"));
+  BOOST_CHECK (loaded.get ("a")->front () == inv);
+  llvm::sys::fs::remove ("inv_store_z3.st");
+}
@@ -19,6 +19,12 @@ BOOST_AUTO_TEST_CASE( muz_test )
           << "Size of INT: " << sizeof (INT) << "\n"
           << "Size of ULONG: " << sizeof (ULONG) << "\n"
           << "Size of ENode: " << sizeof (ENode) << "\n";
+
+  // -- stateless operators carry no data and are shared by all
+  // -- nodes. Up to three children are stored inline in an ENode
+  BOOST_CHECK_EQUAL (sizeof (AND), sizeof (void*));
+  BOOST_CHECK_EQUAL (sizeof (PLUS), sizeof (void*));
+  BOOST_CHECK (sizeof (ENode) <= 8 * sizeof (void*));
       
 
   Expr x = bind::intConst (mkTerm<string> ("x", efac));
@@ -27,6 +33,8 @@ BOOST_AUTO_TEST_CASE( muz_test )
   Expr u = bind::intConst (mkTerm<string> ("u", efac));
   Expr v = bind::intConst (mkTerm<string> ("v", efac));
 
+  BOOST_CHECK (&mk<PLUS> (x, y)->op () == &mk<PLUS> (u, v)->op ());
+
       
   Expr iTy = mk<INT_TY> (efac);
   Expr bTy = mk<BOOL_TY> (efac);
@@ -0,0 +1,164 @@
+/** Memory benchmark for the persistent map of SymStore.
+
+    Replays the symbolic states of a 10k step counterexample: every
+    step copies the state of the previous step and assigns new values
+    to a few registers, as HornCex does for every cut point on the
+    trace. The states are kept in a std::map and in a PersistentMap,
+    and the memory allocated for all the states is compared.
+ */
+#include "ufo/Expr.hpp"
+#include "seahorn/Support/PersistentMap.hh"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <map>
+#include <new>
+
+#define BOOST_TEST_MODULE persistent_map_bench
+#include <boost/test/unit_test.hpp>
+
+using namespace expr;
+using namespace seahorn;
+
+namespace
+{
+  /// bytes currently allocated through operator new
+  size_t g_allocated = 0;
+  /// size of the header that records the size of a block. Keeps the
+  /// alignment of malloc
+  const size_t HEADER = alignof (std::max_align_t);
+}
+
+void *operator new (size_t sz)
+{
+  char *p = static_cast<char*> (std::malloc (sz + HEADER));
+  if (!p) throw std::bad_alloc ();
+  *reinterpret_cast<size_t*> (p) = sz;
+  g_allocated += sz;
+  return p + HEADER;
+}
+
+void operator delete (void *p) noexcept
+{
+  if (!p) return;
+  char *q = static_cast<char*> (p) - HEADER;
+  g_allocated -= *reinterpret_cast<size_t*> (q);
+  std::free (q);
+}
+
+namespace
+{
+  const unsigned STEPS = 10000;
+  const unsigned REGISTERS = 2000;
+  const unsigned WRITES = 16;
+
+  double elapsed (std::chrono::steady_clock::time_point start)
+  {
+    return std::chrono::duration<double>
+      (std::chrono::steady_clock::now () - start).count ();
+  }
+
+  struct Fixture
+  {
+    ExprFactory efac;
+    ExprVector regs;
+    /// the values written at each step
+    std::vector<std::vector<std::pair<Expr,Expr> > > trace;
+
+    Fixture ()
+    {
+      for (unsigned i = 0; i < REGISTERS; ++i)
+        regs.push_back (bind::intConst
+                        (mkTerm<std::string> ("r" + std::to_string (i), efac)));
+
+      unsigned seed = 1;
+      for (unsigned s = 0; s < STEPS; ++s)
+      {
+        trace.push_back (std::vector<std::pair<Expr,Expr> > ());
+        for (unsigned w = 0; w < WRITES; ++w)
+        {
+          seed = seed * 1103515245 + 12345;
+          Expr r = regs [(seed >> 8) % REGISTERS];
+          trace.back ().push_back
+            (std::make_pair (r, variant::variant (s, r)));
+        }
+      }
+    }
+  };
+}
+
+BOOST_FIXTURE_TEST_CASE (cex_replay, Fixture)
+{
+  // -- the initial state defines every register
+  std::map<Expr,Expr> init;
+  PersistentMap<Expr,Expr> pinit;
+  for (const Expr &r : regs)
+  {
+    init [r] = r;
+    pinit.set (r, r);
+  }
+
+  size_t base = g_allocated;
+  auto start = std::chrono::steady_clock::now ();
+  std::vector<std::map<Expr,Expr> > states (1, init);
+  for (auto &step : trace)
+  {
+    states.push_back (states.back ());
+    for (auto &kv : step) states.back () [kv.first] = kv.second;
+  }
+  double tMap = elapsed (start);
+  size_t mMap = g_allocated - base;
+
+  base = g_allocated;
+  start = std::chrono::steady_clock::now ();
+  std::vector<PersistentMap<Expr,Expr> > pstates (1, pinit);
+  for (auto &step : trace)
+  {
+    pstates.push_back (pstates.back ());
+    for (auto &kv : step) pstates.back ().set (kv.first, kv.second);
+  }
+  double tPersistent = elapsed (start);
+  size_t mPersistent = g_allocated - base;
+
+  // -- every snapshot agrees with the corresponding std::map
+  BOOST_REQUIRE_EQUAL (states.size (), pstates.size ());
+  for (size_t i = 0; i < states.size (); i += 97)
+  {
+    BOOST_CHECK_EQUAL (states [i].size (), pstates [i].size ());
+    BOOST_CHECK (std::equal (states [i].begin (), states [i].end (),
+                             pstates [i].begin ()));
+    for (const Expr &r : regs)
+      BOOST_CHECK (*pstates [i].lookup (r) == states [i][r]);
+  }
+  BOOST_CHECK (mPersistent * 10 < mMap);
+
+  llvm::errs () << STEPS << " step counterexample, " << REGISTERS
+                << " registers, " << WRITES << " writes per step\n"
+                << "  std::map:      " << (mMap >> 20) << "MB "
+                << tMap << "s\n"
+                << "  PersistentMap: " << (mPersistent >> 20) << "MB "
+                << tPersistent << "s\n";
+}
+
+BOOST_AUTO_TEST_CASE (erase)
+{
+  PersistentMap<int,int> m;
+  for (int i = 0; i < 1000; ++i) m.set (i, i);
+  PersistentMap<int,int> snapshot (m);
+  for (int i = 0; i < 1000; i += 2) BOOST_CHECK_EQUAL (m.erase (i), 1);
+  BOOST_CHECK_EQUAL (m.erase (0), 0);
+  BOOST_CHECK_EQUAL (m.size (), 500);
+  BOOST_CHECK_EQUAL (snapshot.size (), 1000);
+  BOOST_CHECK (m.lookup (2) == NULL);
+  BOOST_CHECK_EQUAL (*snapshot.lookup (2), 2);
+
+  int expected = 1;
+  for (auto &kv : m)
+  {
+    BOOST_CHECK_EQUAL (kv.first, expected);
+    expected += 2;
+  }
+  BOOST_CHECK_EQUAL (expected, 1001);
+}
@@ -0,0 +1,96 @@
+/** Benchmark for evaluating many expressions in a SymStore.
+
+    The expressions share a long chain of sub-expressions over the
+    registers of the store, as the side conditions and predicates of
+    the edges of a function do. Evaluating each of them with its own
+    dagVisit cache visits the shared part every time; evalAll visits
+    it once.
+ */
+#include "seahorn/SymStore.hh"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+
+#define BOOST_TEST_MODULE symstore_eval_bench
+#include <boost/test/unit_test.hpp>
+
+using namespace expr;
+using namespace seahorn;
+
+namespace
+{
+  const unsigned REGISTERS = 64;
+  const unsigned TERMS = 2000;
+
+  double elapsed (std::chrono::steady_clock::time_point start)
+  {
+    return std::chrono::duration<double>
+      (std::chrono::steady_clock::now () - start).count ();
+  }
+}
+
+BOOST_AUTO_TEST_CASE (shared_subterms)
+{
+  ExprFactory efac;
+  SymStore s (efac);
+
+  ExprVector regs;
+  for (unsigned i = 0; i < REGISTERS; ++i)
+  {
+    regs.push_back (bind::intConst
+                    (mkTerm<std::string> ("r" + std::to_string (i), efac)));
+    s.read (regs.back ());
+  }
+
+  // -- term i extends term i-1, so every term shares all of the
+  // -- previous ones
+  ExprVector terms;
+  Expr acc = regs [0];
+  for (unsigned i = 0; i < TERMS; ++i)
+  {
+    acc = mk<PLUS> (acc, mk<MULT> (regs [i % REGISTERS],
+                                   regs [(i / REGISTERS) % REGISTERS]));
+    terms.push_back (mk<GT> (acc, regs [(i * 7) % REGISTERS]));
+  }
+
+  seahorn::detail::SymStoreEvalVisitor v (s);
+  ExprVector separate;
+  auto start = std::chrono::steady_clock::now ();
+  for (const Expr &t : terms) separate.push_back (dagVisit (v, t));
+  double tSeparate = elapsed (start);
+
+  start = std::chrono::steady_clock::now ();
+  ExprVector batch = s.evalAll (terms);
+  double tBatch = elapsed (start);
+
+  BOOST_CHECK (separate == batch);
+
+  ExprVector out;
+  s.evalAll (terms, std::back_inserter (out));
+  BOOST_CHECK (out == batch);
+
+  llvm::errs () << TERMS << " terms with shared sub-terms\n"
+                << "  separate eval: " << tSeparate << "s\n"
+                << "  evalAll:       " << tBatch << "s\n";
+}
+
+BOOST_AUTO_TEST_CASE (memo_identity)
+{
+  ExprFactory efac;
+  DagVisitMemo memo (efac);
+  {
+    Expr x = bind::intConst (mkTerm<std::string> ("x", efac));
+    Expr y = mk<PLUS> (x, x);
+    memo.insert (&*y, y);
+    memo.insert (&*x, mk<MINUS> (x, x));
+    // -- an identity result does not reference its key
+    BOOST_CHECK_EQUAL (y->use_count (), 1);
+    Expr res;
+    BOOST_CHECK (memo.lookup (&*y, res) && res == y);
+    BOOST_CHECK_EQUAL (memo.size (), 2);
+  }
+  // -- y is reclaimed with its entry. x is kept by its own result
+  BOOST_CHECK_EQUAL (memo.size (), 1);
+  memo.clear ();
+  BOOST_CHECK_EQUAL (memo.size (), 0);
+}